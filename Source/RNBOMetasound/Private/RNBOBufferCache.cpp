@@ -0,0 +1,1086 @@
+#include "RNBOBufferCache.h"
+
+#include "AudioDecompress.h"
+#include "AudioResampler.h"
+#include "Async/ParallelFor.h"
+#include "DSP/FloatArrayMath.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/RunnableThread.h"
+#include "Interfaces/IAudioFormat.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeTryLock.h"
+#include "MetasoundLog.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#elif PLATFORM_UNIX || PLATFORM_APPLE || PLATFORM_ANDROID
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+int32 WaveBufferCacheBudgetMB = 0;
+FAutoConsoleVariableRef CVarWaveBufferCacheBudgetMB(
+    TEXT("au.RNBO.WaveBufferCache.BudgetMB"),
+    WaveBufferCacheBudgetMB,
+    TEXT("Maximum size of all decoded RNBO buffer~ waves, in MB. Waves that don't fit aren't loaded. 0 for no limit.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheRetainMB = 0;
+FAutoConsoleVariableRef CVarWaveBufferCacheRetainMB(
+    TEXT("au.RNBO.WaveBufferCache.RetainMB"),
+    WaveBufferCacheRetainMB,
+    TEXT("Size of decoded RNBO buffer~ waves to keep in memory after they are no longer used, in MB.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheCompactRetained = 0;
+FAutoConsoleVariableRef CVarWaveBufferCacheCompactRetained(
+    TEXT("au.RNBO.WaveBufferCache.CompactRetained"),
+    WaveBufferCacheCompactRetained,
+    TEXT("Keep RNBO buffer~ waves retained by au.RNBO.WaveBufferCache.RetainMB as 16 bit samples, half the memory, and convert them back to float when they are bound again.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheMaxDecodeTasks = 4;
+FAutoConsoleVariableRef CVarWaveBufferCacheMaxDecodeTasks(
+    TEXT("au.RNBO.WaveBufferCache.MaxDecodeTasks"),
+    WaveBufferCacheMaxDecodeTasks,
+    TEXT("Maximum number of RNBO buffer~ waves decoded in parallel.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheDiskCache = 0;
+FAutoConsoleVariableRef CVarWaveBufferCacheDiskCache(
+    TEXT("au.RNBO.WaveBufferCache.DiskCache"),
+    WaveBufferCacheDiskCache,
+    TEXT("Write decoded RNBO buffer~ waves to Saved/RNBO/BufferCache and memory map them from there instead of decoding again.\n")
+        TEXT("Mappings are copy on write: a patch writing into a mapped wave changes it in memory, for every node using the mapping, never the file.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheShareBoundData = 0;
+FAutoConsoleVariableRef CVarWaveBufferCacheShareBoundData(
+    TEXT("au.RNBO.WaveBufferCache.ShareBoundData"),
+    WaveBufferCacheShareBoundData,
+    TEXT("Bind the same decoded RNBO buffer~ wave to every node using it instead of a copy per pin, which saves memory.\n")
+        TEXT("A patch writing into its buffer (poke~, record~) then changes it for every node using the wave, and waves written to are not retained.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheResampleToGraphRate = 0;
+FAutoConsoleVariableRef CVarWaveBufferCacheResampleToGraphRate(
+    TEXT("au.RNBO.WaveBufferCache.ResampleToGraphRate"),
+    WaveBufferCacheResampleToGraphRate,
+    TEXT("Resample RNBO buffer~ waves to the sample rate of the graph using them when they are loaded, instead of binding them at their own rate.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheParallelDecodeFrames = 1 << 20;
+FAutoConsoleVariableRef CVarWaveBufferCacheParallelDecodeFrames(
+    TEXT("au.RNBO.WaveBufferCache.ParallelDecodeFrames"),
+    WaveBufferCacheParallelDecodeFrames,
+    TEXT("PCM RNBO buffer~ waves longer than this many frames are split in ranges of this size decoded in parallel. 0 to always decode on a single thread.\n"),
+    ECVF_Default);
+
+int32 WaveBufferCacheRetireQueueSize = 1024;
+FAutoConsoleVariableRef CVarWaveBufferCacheRetireQueueSize(
+    TEXT("au.RNBO.WaveBufferCache.RetireQueueSize"),
+    WaveBufferCacheRetireQueueSize,
+    TEXT("Number of RNBO buffer~ waves the audio thread can release before the background thread frees them, rounded up to a power of two.\n")
+        TEXT("Read when the cache is created, set it in an ini file. Raise it if the log reports that the queue was full.\n"),
+    ECVF_Default);
+
+// frames decoded per StreamCompressedData/ReadCompressedData call, also fed to the resampler at a time
+constexpr int32 DecodeChunkFrames = 16384;
+
+size_t MBToBytes(int32 mb)
+{
+    return static_cast<size_t>(FMath::Max(mb, 0)) * 1024 * 1024;
+}
+
+void ConvertPCM16(const int16* In, float* Out, int32 Num)
+{
+    // vectorized in SignalProcessing, interleaving is kept as buffer~ expects it
+    Audio::ArrayPcm16ToFloat(MakeArrayView(In, Num), MakeArrayView(Out, Num));
+}
+
+bool IsCancelled(const std::atomic<bool>* bCancelled)
+{
+    return bCancelled != nullptr && bCancelled->load(std::memory_order_relaxed);
+}
+
+// formats whose decoders seek to an exact frame, so ranges can be decoded independently.
+// ADPCM seeks to the start of the compressed block holding the frame, a range would start up to a block early
+bool IsSeekable(FName Format)
+{
+    static const FName PCM(TEXT("PCM"));
+    return Format == PCM;
+}
+
+// a decoder positioned at the start of the wave
+TUniquePtr<ICompressedAudioInfo> OpenDecoder(IAudioInfoFactory& Factory, const FSoundWaveProxyPtr& WaveProxy, FSoundQualityInfo& OutQuality)
+{
+    TUniquePtr<ICompressedAudioInfo> Decompress(Factory.Create());
+    if (!Decompress.IsValid()) {
+        UE_LOG(LogMetaSound, Error, TEXT("RNBO Failed to create decoder for %s"), *WaveProxy->GetRuntimeFormat().ToString());
+        return {};
+    }
+
+    if (WaveProxy->IsStreaming()) {
+        if (!Decompress->StreamCompressedInfo(WaveProxy, &OutQuality)) {
+            UE_LOG(LogMetaSound, Error, TEXT("RNBO Failed to get compressed stream info"));
+            return {};
+        }
+    }
+    else if (!Decompress->ReadCompressedInfo(WaveProxy->GetResourceData(), WaveProxy->GetResourceSize(), &OutQuality)) {
+        UE_LOG(LogMetaSound, Error, TEXT("RNBO Failed to get compressed info"));
+        return {};
+    }
+    return Decompress;
+}
+
+// decode up to Num samples from the decoder's current position into Out, returns the number of samples written
+// a chunk at a time, so the whole range never exists as PCM16 as well
+int32 DecodeInto(ICompressedAudioInfo& Decompress, bool bStreaming, float* Out, int32 Num, int32 NumChannels, const std::atomic<bool>* bCancelled)
+{
+    const int32 chunkSamples = DecodeChunkFrames * NumChannels;
+    TArray<int16> Chunk;
+    Chunk.SetNumUninitialized(chunkSamples);
+
+    int32 offset = 0;
+    while (offset < Num && !IsCancelled(bCancelled)) {
+        const int32 num = FMath::Min(chunkSamples, Num - offset);
+        uint8* dest = reinterpret_cast<uint8*>(Chunk.GetData());
+        const uint32 size = static_cast<uint32>(num * sizeof(int16));
+
+        // both return true once the end of the wave has been reached
+        bool bFinished = false;
+        int32 valid = num;
+        if (bStreaming) {
+            int32 ValidBytes = 0;
+            bFinished = Decompress.StreamCompressedData(dest, false, size, ValidBytes);
+            valid = FMath::Min(num, ValidBytes / static_cast<int32>(sizeof(int16)));
+        }
+        else {
+            bFinished = Decompress.ReadCompressedData(dest, false, size);
+        }
+
+        ConvertPCM16(Chunk.GetData(), Out + offset, valid);
+        offset += valid;
+        if (bFinished || valid == 0) {
+            break;
+        }
+    }
+    return offset;
+}
+
+// disk cache and imported buffer~ file layout: this header followed by the interleaved float samples
+// RNBOMetasound.Build.cs writes the same layout
+struct FDiskCacheHeader
+{
+    static constexpr uint32 Magic = 0x524E4257; // RNBW
+    static constexpr uint32 Version = 1;
+
+    uint32 FileMagic = Magic;
+    uint32 FileVersion = Version;
+    int32 NumChannels = 0;
+    float SampleRate = 0.0f;
+    int64 NumSamples = 0;
+    uint64 Reserved = 0;
+};
+static_assert(sizeof(FDiskCacheHeader) % sizeof(float) == 0, "samples must stay aligned");
+
+// empty if the disk cache is disabled
+FString DiskCachePath(const FSoundWaveProxyPtr& WaveProxy, float SampleRate)
+{
+    if (WaveBufferCacheDiskCache == 0) {
+        return {};
+    }
+
+    // the name alone could be reused by a reimported asset, the compressed data guid changes whenever the data does,
+    // and unlike the data itself it is known for streaming waves too
+    const FString name = FString::Printf(TEXT("%s_%s_%d_%d_%d_%s_%d.bin"),
+        *WaveProxy->GetFName().ToString(),
+        *WaveProxy->GetRuntimeFormat().ToString(),
+        WaveProxy->GetNumFrames(),
+        WaveProxy->GetNumChannels(),
+        static_cast<int32>(WaveProxy->GetSampleRate()),
+        *WaveProxy->GetGUID().ToString(),
+        static_cast<int32>(SampleRate));
+    return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("RNBO"), TEXT("BufferCache"), name);
+}
+
+void WriteCached(const FString& Path, const RNBOMetasound::FDecodedWave& Wave)
+{
+    // write to a temporary file first so a partially written file is never mapped
+    IFileManager& FileManager = IFileManager::Get();
+    const FString dir = FPaths::GetPath(Path);
+    FileManager.MakeDirectory(*dir, true);
+    const FString tmp = FPaths::CreateTempFilename(*dir, TEXT("RNBO"), TEXT(".tmp"));
+
+    TUniquePtr<FArchive> Writer(FileManager.CreateFileWriter(*tmp));
+    if (!Writer.IsValid()) {
+        UE_LOG(LogMetaSound, Warning, TEXT("RNBO failed to create buffer~ disk cache file %s"), *tmp);
+        return;
+    }
+
+    FDiskCacheHeader header;
+    header.NumChannels = Wave.NumChannels;
+    header.SampleRate = Wave.SampleRate;
+    header.NumSamples = Wave.Num();
+    Writer->Serialize(&header, sizeof(header));
+    Writer->Serialize(const_cast<float*>(Wave.GetData()), static_cast<int64>(Wave.SizeInBytes()));
+    const bool bOk = Writer->Close() && !Writer->IsError();
+    Writer.Reset();
+
+    if (!bOk || !FileManager.Move(*Path, *tmp)) {
+        UE_LOG(LogMetaSound, Warning, TEXT("RNBO failed to write buffer~ disk cache file %s"), *Path);
+        FileManager.Delete(*tmp);
+    }
+}
+
+FAutoConsoleCommand CmdWaveBufferCacheStats(
+    TEXT("au.RNBO.WaveBufferCache.Stats"),
+    TEXT("Log the memory used by RNBO buffer~ data.\n"),
+    FConsoleCommandDelegate::CreateLambda([]() {
+        auto stats = RNBOMetasound::FWaveBufferCache::Get().GetStats();
+        UE_LOG(LogMetaSound, Display, TEXT("RNBO buffer~ data: %d resident waves, %.2f MB (%.2f MB retained), %.2f MB compact, %.2f MB bound to core objects"),
+            stats.NumResident,
+            stats.ResidentBytes / (1024.0 * 1024.0),
+            stats.RetainedBytes / (1024.0 * 1024.0),
+            stats.CompactBytes / (1024.0 * 1024.0),
+            stats.BoundBytes / (1024.0 * 1024.0));
+        for (auto& op : stats.Operators) {
+            UE_LOG(LogMetaSound, Display, TEXT("  %s (%p): %.2f MB bound"), op.Name, op.Owner, op.BoundBytes / (1024.0 * 1024.0));
+        }
+    }));
+} // namespace
+
+namespace RNBOMetasound {
+
+FWaveLoad::FWaveLoad(const FSoundWaveProxyPtr& waveProxy, EWaveLoadPriority priority, float sampleRate)
+    : Done(UE_SOURCE_LOCATION)
+    , WaveProxy(waveProxy)
+    , Priority(priority)
+    , SampleRate(sampleRate)
+{
+}
+
+void FWaveHandoff::Post(FDecodedWavePtr Wave, uint32 Generation)
+{
+    Slots[Back] = { MoveTemp(Wave), Generation };
+    Back = Middle.exchange(Back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+    // either a wave the consumer never took, or the slot it already moved out of
+    Slots[Back].Wave.Reset();
+}
+
+bool FWaveHandoff::Take(FDecodedWavePtr& OutWave, uint32& OutGeneration)
+{
+    if ((Middle.load(std::memory_order_relaxed) & FreshBit) == 0) {
+        return false;
+    }
+    Front = Middle.exchange(Front, std::memory_order_acq_rel) & IndexMask;
+    OutWave = MoveTemp(Slots[Front].Wave);
+    OutGeneration = Slots[Front].Generation;
+    return true;
+}
+
+FWaveBufferCache& FWaveBufferCache::Get()
+{
+    static FWaveBufferCache cache;
+    return cache;
+}
+
+FWaveBufferCache::FWaveBufferCache()
+    : RetireQueue(static_cast<uint32>(FMath::Max(WaveBufferCacheRetireQueueSize, 2)))
+    , WakeEvent(FPlatformProcess::GetSynchEventFromPool(false))
+{
+    Worker = FRunnableThread::Create(this, TEXT("RNBOWaveBufferCache"), 0, TPri_BelowNormal);
+}
+
+void FWaveBufferCache::Shutdown()
+{
+    if (Worker != nullptr) {
+        // stops and waits for the current pass
+        Worker->Kill(true);
+        delete Worker;
+        Worker = nullptr;
+    }
+}
+
+void FWaveBufferCache::Wake()
+{
+    if (!bWakePending.exchange(true, std::memory_order_acq_rel)) {
+        WakeEvent->Trigger();
+    }
+}
+
+uint32 FWaveBufferCache::Run()
+{
+    while (!bStopping.load(std::memory_order_acquire)) {
+        WakeEvent->Wait();
+        // cleared before looking, anything posted from here on wakes the worker for another pass
+        bWakePending.store(false, std::memory_order_release);
+        ServiceRequests();
+        DrainRetired();
+    }
+    return 0;
+}
+
+void FWaveBufferCache::Stop()
+{
+    bStopping.store(true, std::memory_order_release);
+    WakeEvent->Trigger();
+}
+
+FWaveBufferCache::FStats FWaveBufferCache::GetStats()
+{
+    FStats stats;
+    stats.BoundBytes = BoundBytes.load(std::memory_order_relaxed);
+
+    {
+        FScopeLock Guard(&RequestMutex);
+        for (auto& request : Requests) {
+            const int64 bytes = request->BoundBytes.load(std::memory_order_relaxed);
+            if (bytes == 0 || request->bDropped.load(std::memory_order_acquire)) {
+                continue;
+            }
+            auto* op = stats.Operators.FindByPredicate([&](const FStats::FOperator& o) { return o.Owner == request->Owner; });
+            if (op == nullptr) {
+                op = &stats.Operators.Add_GetRef({ request->Owner, request->Name, 0 });
+            }
+            op->BoundBytes += bytes;
+        }
+    }
+
+    FScopeLock Guard(&Mutex);
+    for (auto& it : Entries) {
+        auto& e = it.Value;
+        if (e->Wave.IsValid()) {
+            stats.NumResident++;
+            stats.ResidentBytes += static_cast<int64>(e->SizeInBytes);
+            if (e->Retained.IsValid() && e->Retained.GetSharedReferenceCount() == 1) {
+                stats.RetainedBytes += static_cast<int64>(e->SizeInBytes);
+            }
+        }
+        stats.CompactBytes += static_cast<int64>(sizeof(int16)) * e->Compact.Num();
+    }
+    return stats;
+}
+
+float FWaveBufferCache::ResampleRate(const FSoundWaveProxyPtr& WaveProxy, float GraphSampleRate)
+{
+    if (WaveBufferCacheResampleToGraphRate == 0 || !WaveProxy.IsValid() || GraphSampleRate <= 0.0f || GraphSampleRate == WaveProxy->GetSampleRate()) {
+        return 0.0f;
+    }
+    return GraphSampleRate;
+}
+
+FDecodedWavePtr FWaveBufferCache::FindOrDecode(const FSoundWaveProxyPtr& WaveProxy, float SampleRate, const std::atomic<bool>* bCancelled)
+{
+    if (!WaveProxy.IsValid()) {
+        return {};
+    }
+
+    FEntryPtr entry;
+    {
+        FScopeLock Guard(&Mutex);
+        RemoveUnused();
+
+        auto& slot = Entries.FindOrAdd(FKey(WaveProxy, SampleRate));
+        if (!slot.IsValid()) {
+            slot = MakeShared<FEntry, ESPMode::ThreadSafe>();
+        }
+        else if (slot->Compact.Num() > 0 && slot->Wave.IsValid()) {
+            // compacted while the float samples were still on their way out, those are used again
+            slot->Compact.Empty();
+        }
+        slot->LastUsed = ++UseCounter;
+        entry = slot;
+    }
+
+    FScopeLock Guard(&entry->DecodeMutex);
+    FDecodedWavePtr wave = entry->Wave.Pin();
+    if (wave.IsValid() || IsCancelled(bCancelled)) {
+        return wave;
+    }
+
+    double frames = FMath::Max(WaveProxy->GetNumFrames(), 0);
+    if (SampleRate > 0.0f && WaveProxy->GetSampleRate() > 0.0f) {
+        frames *= static_cast<double>(SampleRate) / WaveProxy->GetSampleRate();
+    }
+    const size_t expected = sizeof(float) * static_cast<size_t>(FMath::CeilToInt(frames)) * static_cast<size_t>(FMath::Max(WaveProxy->GetNumChannels(), 0));
+    if (!Reserve(entry, expected)) {
+        UE_LOG(LogMetaSound, Warning, TEXT("RNBO buffer~ wave %s (%d bytes) doesn't fit in au.RNBO.WaveBufferCache.BudgetMB, not loading it"), *WaveProxy->GetFName().ToString(), static_cast<int32>(expected));
+        return {};
+    }
+
+    TArray<int16> compact;
+    int32 compactChannels = 0;
+    float compactSampleRate = 0.0f;
+    {
+        FScopeLock CacheGuard(&Mutex);
+        compact = MoveTemp(entry->Compact);
+        compactChannels = entry->CompactChannels;
+        compactSampleRate = entry->CompactSampleRate;
+    }
+    const FString cachePath = compact.Num() > 0 ? FString() : DiskCachePath(WaveProxy, SampleRate);
+    if (compact.Num() > 0) {
+        TSharedPtr<FDecodedWave, ESPMode::ThreadSafe> expanded(new FDecodedWave());
+        expanded->NumChannels = compactChannels;
+        expanded->SampleRate = compactSampleRate;
+        expanded->Samples.SetNumUninitialized(compact.Num());
+        ConvertPCM16(compact.GetData(), expanded->Samples.GetData(), compact.Num());
+        wave = expanded;
+    }
+    else if (!cachePath.IsEmpty()) {
+        wave = MapFile(cachePath);
+    }
+    if (!wave.IsValid()) {
+        if (SampleRate > 0.0f) {
+            // shares the wave at its own rate with anyone else using it, and only keeps it while resampling otherwise
+            FDecodedWavePtr source = FindOrDecode(WaveProxy, 0.0f, bCancelled);
+            if (source.IsValid()) {
+                wave = Resample(*source, SampleRate, bCancelled);
+            }
+        }
+        else {
+            wave = Decode(WaveProxy, WaveBufferCacheParallelDecodeFrames, bCancelled);
+        }
+        if (wave.IsValid() && !cachePath.IsEmpty()) {
+            WriteCached(cachePath, *wave);
+        }
+    }
+
+    {
+        FScopeLock CacheGuard(&Mutex);
+        entry->bDecoding = false;
+        entry->Wave = wave;
+        entry->SizeInBytes = wave.IsValid() ? wave->SizeInBytes() : 0;
+        if (WaveBufferCacheRetainMB > 0) {
+            entry->Retained = wave;
+        }
+    }
+
+    // before trimming, so compacted waves count at their 16 bit size
+    CompactRetained();
+    FScopeLock CacheGuard(&Mutex);
+    Trim(MBToBytes(WaveBufferCacheRetainMB));
+
+    return wave;
+}
+
+FDecodedWavePtr FWaveBufferCache::Find(const FSoundWaveProxyPtr& WaveProxy, float SampleRate)
+{
+    if (!WaveProxy.IsValid()) {
+        return {};
+    }
+    // called from the audio thread, don't wait for a trim or a lookup in progress
+    FScopeTryLock Guard(&Mutex);
+    if (!Guard.IsLocked()) {
+        return {};
+    }
+    if (auto entry = Entries.Find(FKey(WaveProxy, SampleRate)); entry != nullptr) {
+        (*entry)->LastUsed = ++UseCounter;
+        return (*entry)->Wave.Pin();
+    }
+    return {};
+}
+
+FWaveLoadPtr FWaveBufferCache::Load(const FSoundWaveProxyPtr& WaveProxy, EWaveLoadPriority Priority, float SampleRate)
+{
+    FKey key(WaveProxy, SampleRate);
+    bool bLaunch = false;
+    FWaveLoadPtr load;
+    {
+        FScopeLock Guard(&LoadMutex);
+        // a cancelled load might already have given up decoding, start a new one instead
+        if (auto inflight = LoadsInFlight.Find(key); inflight != nullptr && !(*inflight)->IsCancelled()) {
+            load = *inflight;
+            load->NumRequests++;
+            if (Priority == EWaveLoadPriority::Playing && load->Priority == EWaveLoadPriority::Prefetch && PrefetchQueue.Remove(load) > 0) {
+                load->Priority = Priority;
+                PlayingQueue.Push(load);
+            }
+            return load;
+        }
+
+        load = MakeShared<FWaveLoad, ESPMode::ThreadSafe>(WaveProxy, Priority, SampleRate);
+        LoadsInFlight.Add(key, load);
+        (Priority == EWaveLoadPriority::Playing ? PlayingQueue : PrefetchQueue).Push(load);
+
+        if (NumLoadTasks < FMath::Max(WaveBufferCacheMaxDecodeTasks, 1)) {
+            NumLoadTasks++;
+            bLaunch = true;
+        }
+    }
+
+    if (bLaunch) {
+        UE::Tasks::Launch(
+            UE_SOURCE_LOCATION,
+            [this]() { RunLoads(); },
+            Priority == EWaveLoadPriority::Playing ? UE::Tasks::ETaskPriority::BackgroundHigh : UE::Tasks::ETaskPriority::BackgroundLow);
+    }
+    return load;
+}
+
+void FWaveBufferCache::Cancel(const FWaveLoadPtr& Load)
+{
+    if (!Load.IsValid()) {
+        return;
+    }
+    {
+        FScopeLock Guard(&LoadMutex);
+        if (Load->IsCancelled() || --Load->NumRequests > 0) {
+            return;
+        }
+        Load->bCancelled = true;
+
+        // a running load finishes on its own, one that is still queued is never going to be picked up
+        if (!Load->bQueued) {
+            return;
+        }
+        PlayingQueue.Remove(Load);
+        PrefetchQueue.Remove(Load);
+        Load->bQueued = false;
+        RemoveInFlight(Load);
+    }
+    Load->Done.Trigger();
+}
+
+bool FWaveRequest::Post(const FSoundWaveProxyPtr& waveProxy, float sampleRate, uint32 generation)
+{
+    FScopeTryLock Guard(&Mutex);
+    if (!Guard.IsLocked()) {
+        return false;
+    }
+    // a proxy posted before and not picked up yet is dropped here, the sound wave still owns its data
+    WaveProxy = waveProxy;
+    SampleRate = sampleRate;
+    Generation = generation;
+    Latest.store(generation, std::memory_order_release);
+    bPosted.store(true, std::memory_order_release);
+    FWaveBufferCache::Get().Wake();
+    return true;
+}
+
+void FWaveRequest::Cancel(uint32 generation)
+{
+    Latest.store(generation, std::memory_order_release);
+    FWaveBufferCache::Get().Wake();
+}
+
+void FWaveRequest::Drop()
+{
+    bDropped.store(true, std::memory_order_release);
+    FWaveBufferCache::Get().Wake();
+}
+
+void FWaveBufferCache::AddRequest(FWaveRequestPtr Request)
+{
+    FScopeLock Guard(&RequestMutex);
+    Requests.Add(MoveTemp(Request));
+}
+
+void FWaveBufferCache::DrainRetired()
+{
+    TArray<FDecodedWavePtr> retired;
+    FDecodedWavePtr wave;
+    while (RetireQueue.Dequeue(wave)) {
+        retired.Add(MoveTemp(wave));
+    }
+
+    const uint32 overflows = NumRetireOverflows.load(std::memory_order_relaxed);
+    if (overflows != NumRetireOverflowsReported) {
+        UE_LOG(LogMetaSound, Warning, TEXT("RNBO buffer~ retire queue was full, %u waves were freed on the audio thread. Raise au.RNBO.WaveBufferCache.RetireQueueSize"), overflows - NumRetireOverflowsReported);
+        NumRetireOverflowsReported = overflows;
+    }
+
+    if (retired.Num() == 0) {
+        return;
+    }
+    // freeing them can take a while, don't hold up the requests meanwhile
+    UE::Tasks::Launch(
+        UE_SOURCE_LOCATION,
+        [retired = MoveTemp(retired)]() mutable {
+            retired.Empty();
+        },
+        UE::Tasks::ETaskPriority::BackgroundLow);
+}
+
+void FWaveBufferCache::ServiceRequests()
+{
+    FScopeLock Guard(&RequestMutex);
+    for (int32 i = Requests.Num() - 1; i >= 0; i--) {
+        if (Requests[i]->bDropped.load(std::memory_order_acquire)) {
+            // a post still in flight only touches Handoff, which it shares
+            Cancel(Requests[i]->Load);
+            Requests.RemoveAtSwap(i);
+        }
+        else {
+            ServiceRequest(Requests[i]);
+        }
+    }
+}
+
+void FWaveBufferCache::ServiceRequest(const FWaveRequestPtr& Request)
+{
+    FSoundWaveProxyPtr waveProxy;
+    float sampleRate = 0.0f;
+    uint32 generation = 0;
+    if (Request->bPosted.load(std::memory_order_acquire)) {
+        FScopeLock Guard(&Request->Mutex);
+        waveProxy = MoveTemp(Request->WaveProxy);
+        sampleRate = Request->SampleRate;
+        generation = Request->Generation;
+        Request->bPosted.store(false, std::memory_order_relaxed);
+    }
+
+    // read after the post, a cancel that came in since wins
+    const uint32 latest = Request->Latest.load(std::memory_order_acquire);
+
+    // the previous wave isn't needed anymore, if nobody else wants it stop loading it
+    if (Request->Load.IsValid() && Request->LoadGeneration != latest) {
+        Cancel(Request->Load);
+        Request->Load.Reset();
+    }
+    if (!waveProxy.IsValid() || generation != latest) {
+        return;
+    }
+
+    FWaveLoadPtr load = Load(waveProxy, EWaveLoadPriority::Playing, sampleRate);
+    Request->Load = load;
+    Request->LoadGeneration = generation;
+
+    // posting after the previous post keeps Handoff single producer and the last wave set on the pin the one that
+    // ends up in the buffer, the dataref binds it between blocks
+    Request->Task = UE::Tasks::Launch(
+        UE_SOURCE_LOCATION,
+        [Request, load, generation]() {
+            FDecodedWavePtr Wave = load->Wave;
+            if (load->IsCancelled() || !Wave.IsValid()) {
+                return;
+            }
+            // the patch may write into what it binds, keep that out of the cache and other nodes
+            if (!ShareBoundData()) {
+                Wave = MakePrivate(Wave);
+            }
+
+            Request->Handoff.Post(MoveTemp(Wave), generation);
+        },
+        UE::Tasks::Prerequisites(load->Done, Request->Task),
+        UE::Tasks::ETaskPriority::BackgroundNormal);
+}
+
+FPrivateFileMapping::~FPrivateFileMapping()
+{
+    if (Data == nullptr) {
+        return;
+    }
+#if PLATFORM_WINDOWS
+    UnmapViewOfFile(Data);
+    CloseHandle(Handle);
+#elif PLATFORM_UNIX || PLATFORM_APPLE || PLATFORM_ANDROID
+    munmap(Data, static_cast<size_t>(Size));
+#else
+    FMemory::Free(Data);
+#endif
+}
+
+TUniquePtr<FPrivateFileMapping> FPrivateFileMapping::Map(const FString& Path)
+{
+    TUniquePtr<FPrivateFileMapping> Mapping(new FPrivateFileMapping());
+#if PLATFORM_WINDOWS
+    const FString FullPath = FPaths::ConvertRelativePathToFull(Path);
+    HANDLE File = CreateFileW(*FullPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (File == INVALID_HANDLE_VALUE) {
+        return {};
+    }
+    LARGE_INTEGER FileSize;
+    if (!GetFileSizeEx(File, &FileSize) || FileSize.QuadPart == 0) {
+        CloseHandle(File);
+        return {};
+    }
+    // the mapping keeps the file open
+    HANDLE Handle = CreateFileMappingW(File, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(File);
+    if (Handle == nullptr) {
+        return {};
+    }
+    void* Data = MapViewOfFile(Handle, FILE_MAP_COPY, 0, 0, 0);
+    if (Data == nullptr) {
+        CloseHandle(Handle);
+        return {};
+    }
+    Mapping->Handle = Handle;
+    Mapping->Data = static_cast<uint8*>(Data);
+    Mapping->Size = FileSize.QuadPart;
+#elif PLATFORM_UNIX || PLATFORM_APPLE || PLATFORM_ANDROID
+    const FString FullPath = FPaths::ConvertRelativePathToFull(Path);
+    const int File = open(TCHAR_TO_UTF8(*FullPath), O_RDONLY);
+    if (File < 0) {
+        return {};
+    }
+    struct stat Stat;
+    if (fstat(File, &Stat) != 0 || Stat.st_size == 0) {
+        close(File);
+        return {};
+    }
+    // the mapping keeps the file open
+    void* Data = mmap(nullptr, static_cast<size_t>(Stat.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, File, 0);
+    close(File);
+    if (Data == MAP_FAILED) {
+        return {};
+    }
+    Mapping->Data = static_cast<uint8*>(Data);
+    Mapping->Size = static_cast<int64>(Stat.st_size);
+#else
+    // no private mappings on this platform, read it all instead
+    TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Path));
+    if (!File.IsValid() || File->Size() <= 0) {
+        return {};
+    }
+    Mapping->Size = File->Size();
+    Mapping->Data = static_cast<uint8*>(FMemory::Malloc(static_cast<SIZE_T>(Mapping->Size), alignof(float)));
+    if (!File->Read(Mapping->Data, Mapping->Size)) {
+        return {};
+    }
+#endif
+    return Mapping;
+}
+
+FDecodedWavePtr FWaveBufferCache::MapFile(const FString& Path)
+{
+    if (!FPlatformFileManager::Get().GetPlatformFile().FileExists(*Path)) {
+        return {};
+    }
+
+    // copy on write: buffer~ hands the samples to the patch as writable memory,
+    // a poke~ or record~ into them must never reach the file (or fault on a read only page)
+    TUniquePtr<FPrivateFileMapping> Mapping = FPrivateFileMapping::Map(Path);
+    if (!Mapping.IsValid() || Mapping->GetSize() < static_cast<int64>(sizeof(FDiskCacheHeader))) {
+        return {};
+    }
+
+    FDiskCacheHeader header;
+    FMemory::Memcpy(&header, Mapping->GetData(), sizeof(header));
+    const int64 expected = static_cast<int64>(sizeof(header)) + header.NumSamples * static_cast<int64>(sizeof(float));
+    if (header.FileMagic != FDiskCacheHeader::Magic || header.FileVersion != FDiskCacheHeader::Version || header.NumSamples > MAX_int32 || Mapping->GetSize() < expected) {
+        UE_LOG(LogMetaSound, Warning, TEXT("RNBO ignoring invalid buffer~ data file %s"), *Path);
+        return {};
+    }
+
+    TSharedPtr<FDecodedWave, ESPMode::ThreadSafe> wave(new FDecodedWave());
+    wave->NumChannels = header.NumChannels;
+    wave->SampleRate = header.SampleRate;
+    wave->MappedData = reinterpret_cast<float*>(Mapping->GetData() + sizeof(header));
+    wave->MappedNum = static_cast<int32>(header.NumSamples);
+    wave->Mapping = MoveTemp(Mapping);
+    wave->MappedPath = Path;
+    return wave;
+}
+
+bool FWaveBufferCache::ShareBoundData()
+{
+    return WaveBufferCacheShareBoundData != 0;
+}
+
+FDecodedWavePtr FWaveBufferCache::MakePrivate(const FDecodedWavePtr& Wave)
+{
+    if (!Wave.IsValid()) {
+        return {};
+    }
+    if (!Wave->MappedPath.IsEmpty()) {
+        if (FDecodedWavePtr mapped = MapFile(Wave->MappedPath); mapped.IsValid()) {
+            return mapped;
+        }
+    }
+    TSharedPtr<FDecodedWave, ESPMode::ThreadSafe> copy(new FDecodedWave());
+    copy->NumChannels = Wave->NumChannels;
+    copy->SampleRate = Wave->SampleRate;
+    copy->Samples.Append(Wave->GetData(), Wave->Num());
+    return copy;
+}
+
+void FWaveBufferCache::Retire(FDecodedWavePtr Wave)
+{
+    if (!Wave.IsValid()) {
+        return;
+    }
+    if (!RetireQueue.Enqueue(MoveTemp(Wave))) {
+        // the worker hasn't kept up. There's nowhere to keep the wave without allocating, it is dropped on this
+        // thread when it goes out of scope, count it so the worker can warn about it
+        NumRetireOverflows.fetch_add(1, std::memory_order_relaxed);
+    }
+    Wake();
+}
+
+void FWaveBufferCache::RunLoads()
+{
+    while (true) {
+        FWaveLoadPtr load;
+        {
+            FScopeLock Guard(&LoadMutex);
+            auto& queue = PlayingQueue.Num() > 0 ? PlayingQueue : PrefetchQueue;
+            if (queue.Num() == 0) {
+                NumLoadTasks--;
+                return;
+            }
+            load = queue[0];
+            queue.RemoveAt(0);
+            load->bQueued = false;
+        }
+
+        FDecodedWavePtr wave = FindOrDecode(load->WaveProxy, load->SampleRate, &load->bCancelled);
+        if (!load->IsCancelled()) {
+            load->Wave = MoveTemp(wave);
+        }
+
+        {
+            FScopeLock Guard(&LoadMutex);
+            RemoveInFlight(load);
+        }
+        load->Done.Trigger();
+    }
+}
+
+void FWaveBufferCache::RemoveInFlight(const FWaveLoadPtr& Load)
+{
+    FKey key(Load->WaveProxy, Load->SampleRate);
+    // might have been replaced by a newer load if this one was cancelled
+    if (auto inflight = LoadsInFlight.Find(key); inflight != nullptr && *inflight == Load) {
+        LoadsInFlight.Remove(key);
+    }
+}
+
+bool FWaveBufferCache::Reserve(const FEntryPtr& entry, size_t SizeInBytes)
+{
+    FScopeLock Guard(&Mutex);
+    entry->bDecoding = true;
+    entry->SizeInBytes = SizeInBytes;
+
+    const size_t budget = MBToBytes(WaveBufferCacheBudgetMB);
+    if (budget == 0) {
+        return true;
+    }
+
+    auto used = [this]() -> size_t {
+        size_t total = 0;
+        for (auto& it : Entries) {
+            auto& e = it.Value;
+            if (e->bDecoding || e->Wave.IsValid()) {
+                total += e->SizeInBytes;
+            }
+        }
+        return total;
+    };
+
+    if (used() > budget) {
+        // drop waves we only keep around for reuse and try again
+        Trim(0);
+        if (used() > budget) {
+            entry->bDecoding = false;
+            entry->SizeInBytes = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+void FWaveBufferCache::RemoveUnused()
+{
+    for (auto it = Entries.CreateIterator(); it; ++it) {
+        // an entry that is only referenced by the map isn't being decoded by anyone
+        if (!it.Value()->Wave.IsValid() && it.Value()->Compact.Num() == 0 && it.Value().GetSharedReferenceCount() == 1) {
+            it.RemoveCurrent();
+        }
+    }
+}
+
+void FWaveBufferCache::Trim(size_t RetainBytes)
+{
+    auto retainedBytes = [](const FEntry& e) -> size_t {
+        return e.Compact.Num() > 0 ? sizeof(int16) * static_cast<size_t>(e.Compact.Num()) : e.SizeInBytes;
+    };
+
+    // retained waves nobody else references, least recently used first
+    TArray<FEntry*> unused;
+    size_t retained = 0;
+    for (auto& it : Entries) {
+        auto& e = it.Value;
+        const bool bIdle = e->Retained.IsValid() && e->Retained.GetSharedReferenceCount() == 1;
+        if (bIdle && e->Retained->bBoundWritable.load(std::memory_order_relaxed)) {
+            // bound with au.RNBO.WaveBufferCache.ShareBoundData, the next node to use it gets it as decoded instead
+            e->Retained.Reset();
+            continue;
+        }
+        if (bIdle || e->Compact.Num() > 0) {
+            unused.Push(e.Get());
+            retained += retainedBytes(*e);
+        }
+    }
+    unused.Sort([](const FEntry& a, const FEntry& b) { return a.LastUsed < b.LastUsed; });
+
+    for (FEntry* e : unused) {
+        if (retained <= RetainBytes) {
+            break;
+        }
+        retained -= retainedBytes(*e);
+        e->Retained.Reset();
+        e->Compact.Empty();
+    }
+}
+
+void FWaveBufferCache::CompactRetained()
+{
+    if (WaveBufferCacheCompactRetained == 0) {
+        return;
+    }
+
+    // only retained waves nobody has bound, at their own rate: they were 16 bit before decoding so nothing is lost.
+    // Mapped ones are already paged out by the OS when memory is needed
+    TArray<TPair<FEntryPtr, FDecodedWavePtr>> idle;
+    {
+        FScopeLock Guard(&Mutex);
+        for (auto& it : Entries) {
+            auto& e = it.Value;
+            if (e->Retained.IsValid() && e->Retained.GetSharedReferenceCount() == 1 && it.Key.SampleRate == 0.0f && e->Retained->MappedData == nullptr
+                && !e->Retained->bBoundWritable.load(std::memory_order_relaxed)) {
+                idle.Emplace(e, e->Retained);
+            }
+        }
+    }
+
+    // converting megabytes takes a while, don't hold up lookups from the audio thread meanwhile
+    for (auto& [entry, wave] : idle) {
+        TArray<int16> compact;
+        compact.SetNumUninitialized(wave->Num());
+        Audio::ArrayFloatToPcm16(MakeArrayView(wave->GetData(), wave->Num()), MakeArrayView(compact.GetData(), wave->Num()));
+
+        FScopeLock Guard(&Mutex);
+        // bound again or trimmed while converting, leave it as it is
+        if (entry->Retained != wave || wave.GetSharedReferenceCount() != 2) {
+            continue;
+        }
+        entry->Compact = MoveTemp(compact);
+        entry->CompactChannels = wave->NumChannels;
+        entry->CompactSampleRate = wave->SampleRate;
+        // the float samples go with idle, on this background thread
+        entry->Retained.Reset();
+    }
+}
+
+FDecodedWavePtr FWaveBufferCache::Decode(const FSoundWaveProxyPtr& WaveProxy, int32 RangeFrames, const std::atomic<bool>* bCancelled)
+{
+    FName Format = WaveProxy->GetRuntimeFormat();
+    IAudioInfoFactory* Factory = IAudioInfoFactoryRegistry::Get().Find(Format);
+    if (Factory == nullptr) {
+        UE_LOG(LogMetaSound, Error, TEXT("IAudioInfoFactoryRegistry::Get().Find(%s) failed"), *Format.ToString());
+        return {};
+    }
+
+    FSoundQualityInfo quality;
+    TUniquePtr<ICompressedAudioInfo> Decompress = OpenDecoder(*Factory, WaveProxy, quality);
+    if (!Decompress.IsValid()) {
+        return {};
+    }
+
+    TSharedPtr<FDecodedWave, ESPMode::ThreadSafe> wave(new FDecodedWave());
+    wave->NumChannels = WaveProxy->GetNumChannels();
+    wave->SampleRate = WaveProxy->GetSampleRate();
+
+    const bool bStreaming = WaveProxy->IsStreaming();
+    const int32 total = static_cast<int32>(quality.SampleDataSize / sizeof(int16));
+    const int32 channels = FMath::Max(static_cast<int32>(quality.NumChannels), 1);
+    wave->Samples.SetNumUninitialized(total);
+
+    // long waves in formats that seek to an exact frame are split in ranges decoded in parallel
+    const int32 frames = total / channels;
+    const int32 rangeFrames = FMath::Max(RangeFrames, DecodeChunkFrames);
+    const int32 numRanges = RangeFrames > 0 && IsSeekable(Format) ? FMath::DivideAndRoundUp(frames, rangeFrames) : 1;
+
+    if (numRanges <= 1) {
+        const int32 written = DecodeInto(*Decompress, bStreaming, wave->Samples.GetData(), total, channels, bCancelled);
+        // anything the decoder didn't produce stays silent
+        FMemory::Memzero(wave->Samples.GetData() + written, sizeof(float) * static_cast<size_t>(total - written));
+    }
+    else {
+        // every range has its own decoder and writes to its own part of the block
+        std::atomic<bool> bFailed{ false };
+        ParallelFor(numRanges, [&](int32 range) {
+            const int32 start = range * rangeFrames * channels;
+            const int32 end = range == numRanges - 1 ? total : start + rangeFrames * channels;
+            float* out = wave->Samples.GetData() + start;
+
+            TUniquePtr<ICompressedAudioInfo> rangeDecompress;
+            ICompressedAudioInfo* decoder = Decompress.Get();
+            if (range > 0) {
+                FSoundQualityInfo rangeQuality;
+                rangeDecompress = OpenDecoder(*Factory, WaveProxy, rangeQuality);
+                if (!rangeDecompress.IsValid()) {
+                    bFailed = true;
+                    return;
+                }
+                rangeDecompress->SeekToFrame(static_cast<uint32>(range * rangeFrames));
+                decoder = rangeDecompress.Get();
+            }
+
+            const int32 written = DecodeInto(*decoder, bStreaming, out, end - start, channels, bCancelled);
+            FMemory::Memzero(out + written, sizeof(float) * static_cast<size_t>(end - start - written));
+        });
+        if (bFailed) {
+            return {};
+        }
+    }
+
+    if (IsCancelled(bCancelled)) {
+        return {};
+    }
+    return wave;
+}
+
+FDecodedWavePtr FWaveBufferCache::Resample(const FDecodedWave& Wave, float SampleRate, const std::atomic<bool>* bCancelled)
+{
+    const int32 channels = FMath::Max(Wave.NumChannels, 1);
+    const int32 inFrames = Wave.Num() / channels;
+    const double ratio = static_cast<double>(SampleRate) / Wave.SampleRate;
+    const int32 outFrames = FMath::CeilToInt(inFrames * ratio);
+
+    Audio::FResampler resampler;
+    resampler.Init(Audio::EResamplingMethod::BestSinc, static_cast<float>(ratio), channels);
+
+    TSharedPtr<FDecodedWave, ESPMode::ThreadSafe> wave(new FDecodedWave());
+    wave->NumChannels = Wave.NumChannels;
+    wave->SampleRate = SampleRate;
+    // room for what the filter still holds when the input ends, trimmed below
+    wave->Samples.SetNumUninitialized((outFrames + DecodeChunkFrames) * channels);
+
+    // a chunk at a time straight into the output, so the input never has to be copied into an aligned buffer
+    int32 inOffset = 0;
+    int32 outOffset = 0;
+    while (inOffset < inFrames) {
+        if (IsCancelled(bCancelled)) {
+            return {};
+        }
+        const int32 num = FMath::Min(DecodeChunkFrames, inFrames - inOffset);
+        const bool bEnd = inOffset + num == inFrames;
+        int32 generated = 0;
+        float* in = const_cast<float*>(Wave.GetData()) + static_cast<size_t>(inOffset) * channels;
+        float* out = wave->Samples.GetData() + static_cast<size_t>(outOffset) * channels;
+        if (resampler.ProcessAudio(in, num, bEnd, out, wave->Samples.Num() / channels - outOffset, generated) != 0) {
+            UE_LOG(LogMetaSound, Error, TEXT("RNBO failed to resample buffer~ wave to %f Hz"), SampleRate);
+            return {};
+        }
+        inOffset += num;
+        outOffset += generated;
+    }
+
+    // the exact length at the new rate, silent if the resampler came up short
+    const int32 produced = FMath::Min(outOffset, outFrames);
+    FMemory::Memzero(wave->Samples.GetData() + static_cast<size_t>(produced) * channels, sizeof(float) * static_cast<size_t>(outFrames - produced) * channels);
+    wave->Samples.SetNum(outFrames * channels);
+
+    return wave;
+}
+
+} // namespace RNBOMetasound
@@ -0,0 +1,475 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/Runnable.h"
+#include "MetasoundWave.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+
+namespace RNBOMetasound {
+
+// A private, copy on write mapping of a whole file: pages are read from the file on demand,
+// writes only ever touch this process's copy of the page
+class FPrivateFileMapping
+{
+  public:
+    ~FPrivateFileMapping();
+
+    static TUniquePtr<FPrivateFileMapping> Map(const FString& Path);
+
+    uint8* GetData() const { return Data; }
+    int64 GetSize() const { return Size; }
+
+  private:
+    FPrivateFileMapping() = default;
+
+    uint8* Data = nullptr;
+    int64 Size = 0;
+    // the file mapping object on Windows
+    void* Handle = nullptr;
+};
+
+// Decoded, interleaved samples of a wave, shared by the cache and everyone loading it. Datarefs bind a private copy
+// unless au.RNBO.WaveBufferCache.ShareBoundData is set
+struct FDecodedWave
+{
+    // decoded in memory
+    TArray<float> Samples;
+    // or mapped from the disk cache, see au.RNBO.WaveBufferCache.DiskCache
+    TUniquePtr<FPrivateFileMapping> Mapping;
+    FString MappedPath;
+    float* MappedData = nullptr;
+    int32 MappedNum = 0;
+    // handed to a core object as writable memory, the patch may have changed it since it was decoded
+    mutable std::atomic<bool> bBoundWritable{ false };
+
+    int32 NumChannels = 0;
+    float SampleRate = 0.0f;
+
+    const float* GetData() const { return MappedData != nullptr ? MappedData : Samples.GetData(); }
+    int32 Num() const { return MappedData != nullptr ? MappedNum : Samples.Num(); }
+    size_t SizeInBytes() const { return sizeof(float) * static_cast<size_t>(Num()); }
+};
+
+using FDecodedWavePtr = TSharedPtr<const FDecodedWave, ESPMode::ThreadSafe>;
+
+enum class EWaveLoadPriority : uint8
+{
+    // a sound that is playing is waiting for it
+    Playing,
+    // might be needed later
+    Prefetch
+};
+
+// An asynchronous wave load, shared by everyone who asked for the same wave while it was in flight
+class FWaveLoad
+{
+  public:
+    FWaveLoad(const FSoundWaveProxyPtr& waveProxy, EWaveLoadPriority priority, float sampleRate);
+
+    /** Triggered once Wave is set, use as a task prerequisite. */
+    UE::Tasks::FTaskEvent Done;
+
+    /** Valid once Done has been triggered, unless the wave couldn't be loaded or the load was cancelled. */
+    FDecodedWavePtr Wave;
+
+    bool IsCancelled() const { return bCancelled.load(std::memory_order_relaxed); }
+
+  private:
+    friend class FWaveBufferCache;
+
+    FSoundWaveProxyPtr WaveProxy;
+    EWaveLoadPriority Priority;
+    float SampleRate;
+    // guarded by FWaveBufferCache::LoadMutex
+    int32 NumRequests = 1;
+    bool bQueued = true;
+    std::atomic<bool> bCancelled{ false };
+};
+
+using FWaveLoadPtr = TSharedPtr<FWaveLoad, ESPMode::ThreadSafe>;
+
+/** Lock free handoff of a loaded wave from a background task to the audio thread.
+ *
+ * Single producer, single consumer, the most recently posted wave wins. A triple buffer: neither side allocates, and a
+ * superseded wave is dropped by the producer, so the consumer never frees anything.
+ * Each wave is tagged with the generation it was posted for so the consumer can tell stale ones apart.
+ */
+class FWaveHandoff
+{
+  public:
+    /** Producer side, call from one thread (or chained tasks) at a time. */
+    void Post(FDecodedWavePtr Wave, uint32 Generation);
+
+    /** Consumer side, returns false if nothing new has been posted since the last call. */
+    bool Take(FDecodedWavePtr& OutWave, uint32& OutGeneration);
+
+  private:
+    static constexpr uint8 IndexMask = 0x3;
+    static constexpr uint8 FreshBit = 0x4;
+
+    struct FSlot
+    {
+        FDecodedWavePtr Wave;
+        uint32 Generation = 0;
+    };
+
+    FSlot Slots[3];
+    // index of the slot between producer and consumer, with FreshBit set when it holds a wave not taken yet
+    std::atomic<uint8> Middle{ 1 };
+    uint8 Back = 0;  // producer only
+    uint8 Front = 2; // consumer only
+};
+
+/** Bounded lock free queue, any number of producers and a single consumer.
+ *
+ * Cells are allocated up front, neither side allocates or blocks afterwards. Each cell carries a sequence number that
+ * tells producers whether it is free and the consumer whether it has been filled.
+ */
+template <typename T>
+class TBoundedMpscQueue
+{
+  public:
+    /** Capacity is rounded up to a power of two. */
+    explicit TBoundedMpscQueue(uint32 Capacity)
+        : Mask(FMath::RoundUpToPowerOfTwo(FMath::Max(Capacity, 2u)) - 1)
+        , Cells(new FCell[Mask + 1])
+    {
+        for (uint32 i = 0; i <= Mask; i++) {
+            Cells[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /** Any thread, returns false and leaves Item alone if the queue is full. */
+    bool Enqueue(T&& Item)
+    {
+        uint32 pos = Head.load(std::memory_order_relaxed);
+        while (true) {
+            FCell& cell = Cells[pos & Mask];
+            const int32 diff = static_cast<int32>(cell.Sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.Item = MoveTemp(Item);
+                    cell.Sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                // the consumer hasn't emptied this cell since the last lap
+                return false;
+            }
+            else {
+                pos = Head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Consumer side, call from one thread at a time. */
+    bool Dequeue(T& OutItem)
+    {
+        FCell& cell = Cells[Tail & Mask];
+        if (static_cast<int32>(cell.Sequence.load(std::memory_order_acquire) - (Tail + 1)) < 0) {
+            return false;
+        }
+        OutItem = MoveTemp(cell.Item);
+        cell.Sequence.store(Tail + Mask + 1, std::memory_order_release);
+        Tail++;
+        return true;
+    }
+
+  private:
+    struct FCell
+    {
+        std::atomic<uint32> Sequence{ 0 };
+        T Item;
+    };
+
+    const uint32 Mask;
+    TUniquePtr<FCell[]> Cells;
+    alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> Head{ 0 }; // producers
+    alignas(PLATFORM_CACHE_LINE_SIZE) uint32 Tail = 0;              // consumer only
+};
+
+/** A dataref's request for a wave, posted on the audio thread and carried out by FWaveBufferCache off it.
+ *
+ * Allocated along with the dataref, so asking for a wave never blocks or allocates on the audio thread. Posting wakes
+ * the cache's worker thread, which starts or cancels the load and posts the loaded wave to Handoff.
+ */
+class FWaveRequest
+{
+  public:
+    /** Owner identifies the operator the dataref belongs to and Name its node class, see FStats::Operators. */
+    FWaveRequest(const void* InOwner, const TCHAR* InName)
+        : Owner(InOwner)
+        , Name(InName)
+    {
+    }
+
+    /** Audio thread, load WaveProxy for the given generation instead of whatever was requested before.
+     *
+     * Returns false if the cache is reading the request right now, post it again on the next block.
+     */
+    bool Post(const FSoundWaveProxyPtr& WaveProxy, float SampleRate, uint32 Generation);
+
+    /** Audio thread, stop loading anything requested before the given generation. */
+    void Cancel(uint32 Generation);
+
+    /** The dataref is going away, cancels its load and unregisters the request. */
+    void Drop();
+
+    /** Audio thread, size of the data the dataref has bound to its core object. */
+    void SetBoundBytes(int64 Bytes) { BoundBytes.store(Bytes, std::memory_order_relaxed); }
+
+    /** Loaded waves waiting for the next block, tagged with the generation they were requested for. */
+    FWaveHandoff Handoff;
+
+  private:
+    friend class FWaveBufferCache;
+
+    // the audio thread only ever tries it
+    FCriticalSection Mutex;
+    FSoundWaveProxyPtr WaveProxy;
+    float SampleRate = 0.0f;
+    uint32 Generation = 0;
+    std::atomic<bool> bPosted{ false };
+    std::atomic<uint32> Latest{ 0 };
+    std::atomic<bool> bDropped{ false };
+    std::atomic<int64> BoundBytes{ 0 };
+    const void* Owner;
+    const TCHAR* Name;
+
+    // only touched by the cache
+    FWaveLoadPtr Load;
+    uint32 LoadGeneration = 0;
+    UE::Tasks::FTask Task; // last post to Handoff, every post waits for the previous one
+};
+
+using FWaveRequestPtr = TSharedPtr<FWaveRequest, ESPMode::ThreadSafe>;
+
+/** Process wide cache of decoded waves, keyed by sound wave proxy and runtime format.
+ *
+ * A wave is decoded once, no matter how many pins or operator instances use it, and the decoded block is freed when
+ * the last reference to it goes away.
+ *
+ * au.RNBO.WaveBufferCache.BudgetMB limits the total size of decoded waves, au.RNBO.WaveBufferCache.RetainMB keeps
+ * waves that are no longer used around (least recently used is dropped first) so rebinding them doesn't decode again,
+ * au.RNBO.WaveBufferCache.CompactRetained keeps them as 16 bit samples instead, half the size.
+ * With au.RNBO.WaveBufferCache.DiskCache decoded waves are also written under Saved/RNBO/BufferCache and memory mapped
+ * from there by later sessions.
+ *
+ * Waves can also be requested at a given sample rate, see ResampleRate, each rate is a separate entry.
+ */
+class FWaveBufferCache : private FRunnable
+{
+  public:
+    static FWaveBufferCache& Get();
+
+    /** The rate to request a wave at for a graph running at GraphSampleRate.
+     *
+     * GraphSampleRate if au.RNBO.WaveBufferCache.ResampleToGraphRate is set and the wave's rate differs, 0 (the
+     * wave's own rate) otherwise.
+     */
+    static float ResampleRate(const FSoundWaveProxyPtr& WaveProxy, float GraphSampleRate);
+
+    /** Get the decoded samples for a wave, decoding it if nobody currently holds it.
+     *
+     * Blocks while decoding (or while another thread decodes the same wave), call from a background task.
+     * Returns an invalid pointer if the wave couldn't be decoded or doesn't fit in the budget.
+     * A non zero SampleRate resamples the decoded wave to that rate.
+     */
+    FDecodedWavePtr FindOrDecode(const FSoundWaveProxyPtr& WaveProxy, float SampleRate = 0.0f, const std::atomic<bool>* bCancelled = nullptr);
+
+    /** Get the decoded samples for a wave if someone holds them already (a prefetch for instance), never decodes. */
+    FDecodedWavePtr Find(const FSoundWaveProxyPtr& WaveProxy, float SampleRate = 0.0f);
+
+    /** Load a wave in the background.
+     *
+     * Loads run in parallel, up to au.RNBO.WaveBufferCache.MaxDecodeTasks at a time, Playing before Prefetch.
+     * Asking for a wave that is already being loaded returns the load in flight, raising its priority if needed.
+     */
+    FWaveLoadPtr Load(const FSoundWaveProxyPtr& WaveProxy, EWaveLoadPriority Priority, float SampleRate = 0.0f);
+
+    /** Drop a request made with Load.
+     *
+     * The load is cancelled once every request for it has been dropped: a queued load is skipped, a decode in progress
+     * stops at the next chunk. Done is still triggered.
+     */
+    void Cancel(const FWaveLoadPtr& Load);
+
+    /** Service a dataref's request until it is dropped, call off the audio thread. */
+    void AddRequest(FWaveRequestPtr Request);
+
+    /** Have the worker thread service requests and free retired waves, never blocks or allocates.
+     *
+     * The worker doesn't depend on the game thread, so loads start even while it is blocked loading a map.
+     */
+    void Wake();
+
+    /** Stop the worker thread, on module shutdown. */
+    void Shutdown();
+
+    /** Memory map a file written by the disk cache or imported by RNBOMetasound.Build.cs.
+     *
+     * The mapping is copy on write: writes into the data stay in memory, shared by everyone holding the wave, and
+     * never reach the file.
+     *
+     * Returns an invalid pointer if the file doesn't exist or isn't valid.
+     */
+    static FDecodedWavePtr MapFile(const FString& Path);
+
+    /** Decode a wave at its own rate, without going through the cache or the disk cache.
+     *
+     * PCM waves longer than RangeFrames are split in ranges of that many frames decoded in parallel, 0 decodes on the
+     * calling thread only. FindOrDecode passes au.RNBO.WaveBufferCache.ParallelDecodeFrames.
+     */
+    static FDecodedWavePtr Decode(const FSoundWaveProxyPtr& WaveProxy, int32 RangeFrames, const std::atomic<bool>* bCancelled = nullptr);
+
+    /** Whether datarefs bind the cached wave itself, see au.RNBO.WaveBufferCache.ShareBoundData. */
+    static bool ShareBoundData();
+
+    /** A copy of Wave for a single dataref to bind, so writes from its patch stay its own.
+     *
+     * Mapped waves are mapped again, copy on write, so the copy only costs the pages the patch writes to. Call off
+     * the audio thread.
+     */
+    static FDecodedWavePtr MakePrivate(const FDecodedWavePtr& Wave);
+
+    /** Drop a reference on a background task instead of the calling thread.
+     *
+     * For the audio thread, where dropping the last reference to a wave would free megabytes. Never blocks or
+     * allocates: the reference goes into a preallocated queue that the worker thread empties. If the queue is full the
+     * reference is dropped on the calling thread after all, that is counted and logged by the worker.
+     */
+    void Retire(FDecodedWavePtr Wave);
+
+    struct FStats
+    {
+        // decoded waves someone holds, each counted once
+        int32 NumResident = 0;
+        int64 ResidentBytes = 0;
+        // kept for reuse by au.RNBO.WaveBufferCache.RetainMB, included in ResidentBytes
+        int64 RetainedBytes = 0;
+        // retained as 16 bit samples, not included in ResidentBytes
+        int64 CompactBytes = 0;
+        // data bound to core objects, a wave bound by several datarefs is counted for each of them
+        int64 BoundBytes = 0;
+
+        struct FOperator
+        {
+            const void* Owner = nullptr;
+            const TCHAR* Name = nullptr;
+            int64 BoundBytes = 0;
+        };
+        // BoundBytes split by the operator the datarefs belong to, only operators with data bound
+        TArray<FOperator> Operators;
+    };
+
+    /** Memory used by buffer~ data right now, also logged by the au.RNBO.WaveBufferCache.Stats console command. */
+    FStats GetStats();
+
+    /** Called by datarefs as they bind and release data, see FStats::BoundBytes. */
+    void AddBoundBytes(int64 Delta) { BoundBytes.fetch_add(Delta, std::memory_order_relaxed); }
+
+  private:
+    FWaveBufferCache();
+
+    // FRunnable, the worker thread
+    virtual uint32 Run() override;
+    virtual void Stop() override;
+
+    struct FKey
+    {
+        FObjectKey Wave;
+        FName Format;
+        float SampleRate = 0.0f; // 0 for the wave's own rate
+
+        FKey(const FSoundWaveProxyPtr& WaveProxy, float sampleRate)
+            : Wave(WaveProxy->GetFObjectKey())
+            , Format(WaveProxy->GetRuntimeFormat())
+            , SampleRate(sampleRate)
+        {
+        }
+
+        bool operator==(const FKey& other) const
+        {
+            return Wave == other.Wave && Format == other.Format && SampleRate == other.SampleRate;
+        }
+
+        friend uint32 GetTypeHash(const FKey& key)
+        {
+            return HashCombine(HashCombine(GetTypeHash(key.Wave), GetTypeHash(key.Format)), GetTypeHash(key.SampleRate));
+        }
+    };
+
+    struct FEntry
+    {
+        // held while decoding so concurrent requests for the same wave wait instead of decoding again
+        FCriticalSection DecodeMutex;
+        TWeakPtr<const FDecodedWave, ESPMode::ThreadSafe> Wave;
+        // keeps an unused wave alive while it fits in the retain budget
+        FDecodedWavePtr Retained;
+        // or its samples as 16 bit, see au.RNBO.WaveBufferCache.CompactRetained
+        TArray<int16> Compact;
+        int32 CompactChannels = 0;
+        float CompactSampleRate = 0.0f;
+        size_t SizeInBytes = 0;
+        uint64 LastUsed = 0;
+        bool bDecoding = false;
+    };
+
+    using FEntryPtr = TSharedPtr<FEntry, ESPMode::ThreadSafe>;
+
+    static FDecodedWavePtr Resample(const FDecodedWave& Wave, float SampleRate, const std::atomic<bool>* bCancelled);
+
+    // pulls loads off the queues until they are empty
+    void RunLoads();
+    // expects LoadMutex to be held
+    void RemoveInFlight(const FWaveLoadPtr& Load);
+
+    // worker thread, frees retired waves and starts or cancels the loads posted to requests
+    void DrainRetired();
+    void ServiceRequests();
+    void ServiceRequest(const FWaveRequestPtr& Request);
+
+    // make room for a wave of the given size, returns false if it doesn't fit in the budget
+    bool Reserve(const FEntryPtr& entry, size_t SizeInBytes);
+
+    // expects Mutex to be held
+    void RemoveUnused();
+    void Trim(size_t RetainBytes);
+    // takes Mutex itself, only while picking waves and swapping the 16 bit samples in, never while converting
+    void CompactRetained();
+
+    FCriticalSection Mutex;
+    TMap<FKey, FEntryPtr> Entries;
+    uint64 UseCounter = 0;
+
+    // only held to queue or dequeue loads, never while launching or decoding
+    FCriticalSection LoadMutex;
+    TMap<FKey, FWaveLoadPtr> LoadsInFlight;
+    TArray<FWaveLoadPtr> PlayingQueue;
+    TArray<FWaveLoadPtr> PrefetchQueue;
+    int32 NumLoadTasks = 0;
+
+    // never taken on the audio thread
+    FCriticalSection RequestMutex;
+    TArray<FWaveRequestPtr> Requests;
+
+    // sized by au.RNBO.WaveBufferCache.RetireQueueSize when the cache is created
+    TBoundedMpscQueue<FDecodedWavePtr> RetireQueue;
+    // releases that found the queue full, reported by the worker
+    std::atomic<uint32> NumRetireOverflows{ 0 };
+    uint32 NumRetireOverflowsReported = 0;
+
+    std::atomic<int64> BoundBytes{ 0 };
+
+    FRunnableThread* Worker = nullptr;
+    FEvent* WakeEvent = nullptr;
+    // set by the first Wake since the worker last looked, so only that one triggers the event
+    std::atomic<bool> bWakePending{ false };
+    std::atomic<bool> bStopping{ false };
+};
+
+} // namespace RNBOMetasound
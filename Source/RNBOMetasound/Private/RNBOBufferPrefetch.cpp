@@ -0,0 +1,78 @@
+#include "RNBOBufferPrefetch.h"
+#include "RNBOBufferCache.h"
+
+#include "Async/Async.h"
+
+using RNBOMetasound::EWaveLoadPriority;
+using RNBOMetasound::FDecodedWavePtr;
+using RNBOMetasound::FWaveBufferCache;
+
+void URNBOPrefetchedBuffers::Release()
+{
+    // don't free them on the game thread
+    for (auto& Wave : Waves) {
+        FWaveBufferCache::Get().Retire(MoveTemp(Wave));
+    }
+    Waves.Reset();
+}
+
+void URNBOPrefetchedBuffers::Add(FDecodedWavePtr Wave)
+{
+    Waves.Add(MoveTemp(Wave));
+}
+
+URNBOBufferPrefetch* URNBOBufferPrefetch::PrefetchRNBOBuffers(UObject* WorldContextObject, const TArray<USoundWave*>& SoundWaves, float SampleRate)
+{
+    URNBOBufferPrefetch* Action = NewObject<URNBOBufferPrefetch>();
+    Action->SoundWaves.Append(SoundWaves);
+    Action->SampleRate = SampleRate;
+    Action->Buffers = NewObject<URNBOPrefetchedBuffers>();
+    // keeps the action alive until SetReadyToDestroy
+    Action->RegisterWithGameInstance(WorldContextObject);
+    return Action;
+}
+
+void URNBOBufferPrefetch::Activate()
+{
+    if (SoundWaves.Num() == 0) {
+        OnCompleted.Broadcast(0, 0, Buffers);
+        SetReadyToDestroy();
+        return;
+    }
+
+    for (USoundWave* SoundWave : SoundWaves) {
+        FSoundWaveProxyPtr WaveProxy = SoundWave != nullptr ? SoundWave->CreateSoundWaveProxy() : nullptr;
+        if (!WaveProxy.IsValid()) {
+            WaveLoaded({});
+            continue;
+        }
+
+        // the same cache entry a node binding this wave will look up
+        auto Load = FWaveBufferCache::Get().Load(WaveProxy, EWaveLoadPriority::Prefetch, FWaveBufferCache::ResampleRate(WaveProxy, SampleRate));
+        UE::Tasks::Launch(
+            UE_SOURCE_LOCATION,
+            [WeakThis = TWeakObjectPtr<URNBOBufferPrefetch>(this), Load]() {
+                AsyncTask(ENamedThreads::GameThread, [WeakThis, Wave = Load->Wave]() {
+                    if (URNBOBufferPrefetch* Action = WeakThis.Get()) {
+                        Action->WaveLoaded(Wave);
+                    }
+                });
+            },
+            UE::Tasks::Prerequisites(Load->Done),
+            UE::Tasks::ETaskPriority::BackgroundLow);
+    }
+}
+
+void URNBOBufferPrefetch::WaveLoaded(FDecodedWavePtr Wave)
+{
+    if (Wave.IsValid()) {
+        Buffers->Add(MoveTemp(Wave));
+    }
+    NumLoaded++;
+
+    OnProgress.Broadcast(NumLoaded, SoundWaves.Num(), Buffers);
+    if (NumLoaded == SoundWaves.Num()) {
+        OnCompleted.Broadcast(NumLoaded, SoundWaves.Num(), Buffers);
+        SetReadyToDestroy();
+    }
+}
@@ -0,0 +1,148 @@
+#include "RNBOCoreObjectPool.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Tasks/Task.h"
+
+namespace {
+int32 CoreObjectPoolPrewarmCount = 2;
+FAutoConsoleVariableRef CVarCoreObjectPoolPrewarmCount(
+    TEXT("au.RNBO.CoreObjectPool.PrewarmCount"),
+    CoreObjectPoolPrewarmCount,
+    TEXT("Number of prepared RNBO core objects kept ready per export and sample rate/block size.\n"),
+    ECVF_Default);
+
+int32 CoreObjectPoolMaxFree = 8;
+FAutoConsoleVariableRef CVarCoreObjectPoolMaxFree(
+    TEXT("au.RNBO.CoreObjectPool.MaxFree"),
+    CoreObjectPoolMaxFree,
+    TEXT("Maximum number of released RNBO core objects kept for reuse per export and sample rate/block size.\n"),
+    ECVF_Default);
+} // namespace
+
+namespace RNBOMetasound {
+
+void FCoreObjectReleaser::operator()(RNBO::CoreObject* obj) const
+{
+    if (obj == nullptr) {
+        return;
+    }
+    if (!Pool.IsValid()) {
+        delete obj;
+        return;
+    }
+    Pool->Release(obj, SampleRate, BlockSize);
+}
+
+FCoreObjectPool::FCoreObjectPool(FRNBOFactoryFunction factory)
+    : Factory(factory)
+{
+}
+
+FCoreObjectPtr FCoreObjectPool::Acquire(float sampleRate, int32 blockSize)
+{
+    TUniquePtr<RNBO::CoreObject> obj;
+    {
+        FScopeLock Guard(&Mutex);
+        auto& bucket = FindOrAddBucket(sampleRate, blockSize);
+        if (bucket.Free.Num() > 0) {
+            obj = bucket.Free.Pop(false);
+        }
+    }
+    if (!obj.IsValid()) {
+        obj.Reset(Create(sampleRate, blockSize));
+    }
+    Refill(sampleRate, blockSize);
+
+    return FCoreObjectPtr(obj.Release(), FCoreObjectReleaser{ AsShared(), sampleRate, blockSize });
+}
+
+void FCoreObjectPool::ResetCoreObject(RNBO::CoreObject& obj, float sampleRate, int32 blockSize) const
+{
+    // drop buffers bound by the previous user
+    for (RNBO::DataRefIndex i = 0; i < obj.getNumExternalDataRefs(); i++) {
+        obj.releaseExternalData(obj.getExternalDataId(i));
+    }
+
+    // parameters of every type, message state and scheduled events all live in the patcher, a new one has none of
+    // the previous user's
+    obj.setPatcher(CreatePatcher());
+    obj.prepareToProcess(sampleRate, blockSize, true);
+}
+
+RNBO::CoreObject* FCoreObjectPool::Create(float sampleRate, int32 blockSize) const
+{
+    auto obj = new RNBO::CoreObject(CreatePatcher());
+    obj->prepareToProcess(sampleRate, blockSize);
+    return obj;
+}
+
+RNBO::UniquePtr<RNBO::PatcherInterface> FCoreObjectPool::CreatePatcher() const
+{
+    return RNBO::UniquePtr<RNBO::PatcherInterface>(Factory(RNBO::Platform::get())());
+}
+
+void FCoreObjectPool::Refill(float sampleRate, int32 blockSize)
+{
+    {
+        FScopeLock Guard(&Mutex);
+        auto& bucket = FindOrAddBucket(sampleRate, blockSize);
+        if (bucket.bRefilling || bucket.Free.Num() >= CoreObjectPoolPrewarmCount) {
+            return;
+        }
+        bucket.bRefilling = true;
+    }
+
+    // the task keeps the pool alive, it may outlive the static holding it at shutdown
+    UE::Tasks::Launch(
+        UE_SOURCE_LOCATION,
+        [this, Self = AsShared(), sampleRate, blockSize]() {
+            while (true) {
+                {
+                    FScopeLock Guard(&Mutex);
+                    auto& bucket = FindOrAddBucket(sampleRate, blockSize);
+                    if (bucket.Free.Num() >= CoreObjectPoolPrewarmCount) {
+                        bucket.bRefilling = false;
+                        return;
+                    }
+                }
+                TUniquePtr<RNBO::CoreObject> obj(Create(sampleRate, blockSize));
+
+                FScopeLock Guard(&Mutex);
+                FindOrAddBucket(sampleRate, blockSize).Free.Emplace(MoveTemp(obj));
+            }
+        },
+        UE::Tasks::ETaskPriority::BackgroundNormal);
+}
+
+void FCoreObjectPool::Release(RNBO::CoreObject* obj, float sampleRate, int32 blockSize)
+{
+    // resetting isn't free, keep it off the thread tearing down the graph
+    UE::Tasks::Launch(
+        UE_SOURCE_LOCATION,
+        [this, Self = AsShared(), obj, sampleRate, blockSize]() {
+            TUniquePtr<RNBO::CoreObject> owned(obj);
+            ResetCoreObject(*owned, sampleRate, blockSize);
+
+            FScopeLock Guard(&Mutex);
+            auto& bucket = FindOrAddBucket(sampleRate, blockSize);
+            if (bucket.Free.Num() < CoreObjectPoolMaxFree) {
+                bucket.Free.Emplace(MoveTemp(owned));
+            }
+        },
+        UE::Tasks::ETaskPriority::BackgroundNormal);
+}
+
+FCoreObjectPool::FBucket& FCoreObjectPool::FindOrAddBucket(float sampleRate, int32 blockSize)
+{
+    for (auto& bucket : Buckets) {
+        if (bucket.SampleRate == sampleRate && bucket.BlockSize == blockSize) {
+            return bucket;
+        }
+    }
+    auto& bucket = Buckets.AddDefaulted_GetRef();
+    bucket.SampleRate = sampleRate;
+    bucket.BlockSize = blockSize;
+    return bucket;
+}
+
+} // namespace RNBOMetasound
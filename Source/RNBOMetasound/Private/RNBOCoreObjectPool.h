@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+// visual studio warnings we're having trouble with
+#pragma warning(disable : 4800 4065 4668 4804 4018 4060 4554 4018)
+#include "RNBO.h"
+
+#include <memory>
+
+namespace RNBOMetasound {
+
+using FRNBOFactoryFunction = RNBO::PatcherFactoryFunctionPtr (*)(RNBO::PlatformInterface* platformInterface);
+
+class FCoreObjectPool;
+
+struct FCoreObjectReleaser
+{
+    TSharedPtr<FCoreObjectPool, ESPMode::ThreadSafe> Pool;
+    float SampleRate = 0.0f;
+    int32 BlockSize = 0;
+
+    void operator()(RNBO::CoreObject* obj) const;
+};
+
+using FCoreObjectPtr = std::unique_ptr<RNBO::CoreObject, FCoreObjectReleaser>;
+
+/** Per export pool of prepared core objects.
+ *
+ * Objects are created and prepared on a background task ahead of time, for every sample rate/block size combination
+ * that has been requested. Released objects are reset on a background task and put back in the pool.
+ * Background tasks hold a reference to the pool, create it with MakeShared.
+ */
+class FCoreObjectPool : public TSharedFromThis<FCoreObjectPool, ESPMode::ThreadSafe>
+{
+  public:
+    FCoreObjectPool(FRNBOFactoryFunction factory);
+
+    /** Get a prepared core object, creates one synchronously if the pool is empty. */
+    FCoreObjectPtr Acquire(float sampleRate, int32 blockSize);
+
+    /** Put a core object back to its just constructed state by giving it a new patcher, external data is released.
+     *
+     * Allocates, call from a background task or from where building the operator would be fine.
+     */
+    void ResetCoreObject(RNBO::CoreObject& obj, float sampleRate, int32 blockSize) const;
+
+  private:
+    friend struct FCoreObjectReleaser;
+
+    struct FBucket
+    {
+        float SampleRate = 0.0f;
+        int32 BlockSize = 0;
+        bool bRefilling = false;
+        TArray<TUniquePtr<RNBO::CoreObject>> Free;
+    };
+
+    RNBO::CoreObject* Create(float sampleRate, int32 blockSize) const;
+    RNBO::UniquePtr<RNBO::PatcherInterface> CreatePatcher() const;
+    void Refill(float sampleRate, int32 blockSize);
+    void Release(RNBO::CoreObject* obj, float sampleRate, int32 blockSize);
+
+    // expects Mutex to be held
+    FBucket& FindOrAddBucket(float sampleRate, int32 blockSize);
+
+    FRNBOFactoryFunction Factory;
+    FCriticalSection Mutex;
+    TArray<FBucket> Buckets;
+};
+
+} // namespace RNBOMetasound
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <array>
+#include <utility>
+
+namespace RNBOMetasound {
+
+enum class ERNBOParamType : uint8
+{
+    None,
+    Float,
+    Int,
+    Bool
+};
+
+// The types below are emitted by RNBOMetasound.Build.cs from each export's description.json
+// Each export gets a description struct with static constexpr members:
+//   ClassName, DisplayName, ParamCount, NumInputChannels, NumOutputChannels,
+//   Params, InputSignals, OutputSignals, Inports, Outports, DataRefs (std::array of the entries below)
+//   bMIDIIn, bMIDIOut, bTransport
+
+struct FRNBOExportParam
+{
+    uint32 Index;
+    ERNBOParamType Type;
+    bool bInput;
+    bool bOutput;
+    float InitialValue;
+    const TCHAR* Name;
+    const TCHAR* DisplayName;
+    const TCHAR* Id;
+};
+
+struct FRNBOExportSignal
+{
+    size_t Channel;
+    const TCHAR* Name;
+    const TCHAR* Tooltip;
+    const TCHAR* DisplayName;
+};
+
+struct FRNBOExportPort
+{
+    const char* Tag;
+    const TCHAR* Name;
+};
+
+struct FRNBOExportDataRef
+{
+    uint32 Index;
+    const TCHAR* Name;
+    // samples imported from the patch's buffer~ @file, relative to the plugin's Resources (packaged) or Intermediate directory, nullptr if none
+    const TCHAR* File;
+};
+
+// Entry of a table indexed by RNBO::ParameterIndex, points at the typed slot for that param (if any)
+struct FRNBOParamSlot
+{
+    ERNBOParamType Type = ERNBOParamType::None;
+    size_t Slot = 0;
+};
+
+template <class Desc>
+constexpr size_t CountParams(bool bInput, ERNBOParamType type)
+{
+    size_t count = 0;
+    for (auto& p : Desc::Params) {
+        if ((bInput ? p.bInput : p.bOutput) && p.Type == type) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// the params of one type and direction, in parameter index order
+template <class Desc, bool bInput, ERNBOParamType Type>
+constexpr std::array<FRNBOExportParam, CountParams<Desc>(bInput, Type)> FilterParams()
+{
+    std::array<FRNBOExportParam, CountParams<Desc>(bInput, Type)> params{};
+    size_t i = 0;
+    for (auto& p : Desc::Params) {
+        if ((bInput ? p.bInput : p.bOutput) && p.Type == Type) {
+            params[i++] = p;
+        }
+    }
+    return params;
+}
+
+template <size_t Count, size_t NumFloat, size_t NumInt, size_t NumBool>
+constexpr std::array<FRNBOParamSlot, Count> ParamSlots(
+    const std::array<FRNBOExportParam, NumFloat>& floatParams,
+    const std::array<FRNBOExportParam, NumInt>& intParams,
+    const std::array<FRNBOExportParam, NumBool>& boolParams)
+{
+    std::array<FRNBOParamSlot, Count> slots{};
+    for (size_t i = 0; i < NumFloat; i++) {
+        if (floatParams[i].Index < Count) {
+            slots[floatParams[i].Index] = { ERNBOParamType::Float, i };
+        }
+    }
+    for (size_t i = 0; i < NumInt; i++) {
+        if (intParams[i].Index < Count) {
+            slots[intParams[i].Index] = { ERNBOParamType::Int, i };
+        }
+    }
+    for (size_t i = 0; i < NumBool; i++) {
+        if (boolParams[i].Index < Count) {
+            slots[boolParams[i].Index] = { ERNBOParamType::Bool, i };
+        }
+    }
+    return slots;
+}
+
+// parameter indices of float, then int, then bool params
+template <size_t NumFloat, size_t NumInt, size_t NumBool>
+constexpr std::array<uint32, NumFloat + NumInt + NumBool> ParamIndices(
+    const std::array<FRNBOExportParam, NumFloat>& floatParams,
+    const std::array<FRNBOExportParam, NumInt>& intParams,
+    const std::array<FRNBOExportParam, NumBool>& boolParams)
+{
+    std::array<uint32, NumFloat + NumInt + NumBool> indices{};
+    size_t o = 0;
+    for (auto& p : floatParams) {
+        indices[o++] = p.Index;
+    }
+    for (auto& p : intParams) {
+        indices[o++] = p.Index;
+    }
+    for (auto& p : boolParams) {
+        indices[o++] = p.Index;
+    }
+    return indices;
+}
+
+namespace Detail {
+template <typename T, typename F, size_t... I>
+std::array<T, sizeof...(I)> MakeArray(F&& func, std::index_sequence<I...>)
+{
+    return { { func(I)... } };
+}
+} // namespace Detail
+
+// construct each element of a fixed size array in place, for types that can't be default constructed
+template <typename T, size_t N, typename F>
+std::array<T, N> MakeArray(F&& func)
+{
+    return Detail::MakeArray<T>(func, std::make_index_sequence<N>());
+}
+
+} // namespace RNBOMetasound
@@ -8,6 +8,8 @@
 #include "MetasoundExecutableOperator.h"
 #include "MetasoundOperatorSettings.h"
 #include "MetasoundDataTypeRegistrationMacro.h"
+#include "HAL/IConsoleManager.h"
+#include "MetasoundLog.h"
 
 #include <algorithm>
 
@@ -40,11 +42,36 @@ struct Metasound::TEnableAutoConverterNodeRegistration<FromDataType, RNBOMetasou
 
 REGISTER_METASOUND_DATATYPE(RNBOMetasound::FMIDIBuffer, "MIDIBuffer")
 
+namespace {
+int32 MIDIBufferCapacity = 1024;
+FAutoConsoleVariableRef CVarMIDIBufferCapacity(
+    TEXT("au.RNBO.MIDIBuffer.Capacity"),
+    MIDIBufferCapacity,
+    TEXT("Number of packets a MIDI pin can hold, allocated when the pin is created. 0 grows as needed, which may allocate on the audio thread.\n"),
+    ECVF_Default);
+
+int32 MIDIBufferPayloadBytes = 4096;
+FAutoConsoleVariableRef CVarMIDIBufferPayloadBytes(
+    TEXT("au.RNBO.MIDIBuffer.PayloadBytes"),
+    MIDIBufferPayloadBytes,
+    TEXT("Bytes of messages longer than 3 bytes (SysEx) a MIDI pin can hold, allocated when the pin is created.\n"),
+    ECVF_Default);
+
+int32 MIDIBufferOverflowPolicy = 1;
+FAutoConsoleVariableRef CVarMIDIBufferOverflowPolicy(
+    TEXT("au.RNBO.MIDIBuffer.OverflowPolicy"),
+    MIDIBufferOverflowPolicy,
+    TEXT("What a full MIDI pin does with new packets. 0: drop the oldest packets, 1: drop the new packet, 2: replace a pending value of the same controller, or drop the new packet.\n"),
+    ECVF_Default);
+} // namespace
+
 namespace RNBOMetasound {
 
 FMIDIPacket::FMIDIPacket(int32 frame, size_t length, const uint8_t* data)
     : mFrame(frame)
-    , mLength(static_cast<uint8_t>(std::min(length, mData.size())))
+    , mData{}
+    , mLength(static_cast<uint32>(length))
+    , mLongData(length > mData.size() ? data : nullptr)
 {
     for (auto i = 0; i < std::min(length, mData.size()); i++) {
         mData[i] = data[i];
@@ -71,6 +98,10 @@ const std::array<uint8_t, 3>& FMIDIPacket::Data() const
 {
     return mData;
 }
+const uint8_t* FMIDIPacket::Bytes() const
+{
+    return mLongData != nullptr ? mLongData : mData.data();
+}
 size_t FMIDIPacket::Length() const
 {
     return static_cast<size_t>(mLength);
@@ -99,24 +130,61 @@ FMIDIPacket FMIDIPacket::CloneTo(int32 frame) const
 }
 
 FMIDIBuffer::FMIDIBuffer(const Metasound::FOperatorSettings& InSettings)
+    : FMIDIBuffer(InSettings, DefaultCapacity(), DefaultPayloadBytes(), DefaultOverflowPolicy())
+{
+}
+
+FMIDIBuffer::FMIDIBuffer(const Metasound::FOperatorSettings& InSettings, int32 InCapacity, int32 InPayloadBytes, EMIDIOverflowPolicy InPolicy)
     : NumFramesPerBlock(InSettings.GetNumFramesPerBlock())
+    , bFixedCapacity(InCapacity > 0)
+    , Policy(InPolicy)
+{
+    if (bFixedCapacity) {
+        Events.SetNumUninitialized(static_cast<int32>(FMath::RoundUpToPowerOfTwo(static_cast<uint32>(InCapacity))));
+        Payloads.SetNumUninitialized(std::clamp(InPayloadBytes, 0, MaxPayloadBytes));
+    }
+}
+
+int32 FMIDIBuffer::DefaultCapacity()
 {
+    return std::max(MIDIBufferCapacity, 0);
+}
+
+int32 FMIDIBuffer::DefaultPayloadBytes()
+{
+    return std::max(MIDIBufferPayloadBytes, 0);
+}
+
+EMIDIOverflowPolicy FMIDIBuffer::DefaultOverflowPolicy()
+{
+    return static_cast<EMIDIOverflowPolicy>(std::clamp(MIDIBufferOverflowPolicy, 0, 2));
 }
 
 void FMIDIBuffer::AdvanceBlock()
 {
-    Packets.RemoveAt(0, CountInBlock, false);
-    CountInBlock = 0;
-    LastFrame = -1;
+    if (Dropped != DroppedReported) {
+        UE_LOG(LogMetaSound, Verbose, TEXT("RNBO MIDI buffer full, dropped %d packets this block (%d in total, peak %d of %d)"), Dropped - DroppedReported, Dropped, Peak, Events.Num());
+        DroppedReported = Dropped;
+    }
 
-    const int32 cnt = Packets.Num();
-    for (int32 i = 0; i < cnt; i++) {
-        auto& packet = Packets[i];
-        packet.Advance(NumFramesPerBlock);
-        if (packet.Frame() < NumFramesPerBlock) {
-            CountInBlock++;
+    if (NumLong > 0 || Notes.Num() > 0) {
+        for (int32 i = 0; i < CountInBlock; i++) {
+            Forget(i);
+            ForgetNote(At(i));
         }
-        LastFrame = packet.Frame();
+    }
+    Head = Count > CountInBlock ? (Head + CountInBlock) & (Events.Num() - 1) : 0;
+    Count -= CountInBlock;
+    BlockStart += static_cast<uint32>(NumFramesPerBlock);
+
+    // packets are sorted, only the ones in the new block are visited
+    CountInBlock = 0;
+    while (CountInBlock < Count && FrameOf(At(CountInBlock)) < NumFramesPerBlock) {
+        CountInBlock++;
+    }
+
+    if (PendingOffs.Num() > 0) {
+        MergeDueOffs();
     }
 }
 
@@ -125,37 +193,49 @@ int32 FMIDIBuffer::NumInBlock() const
     return CountInBlock;
 }
 
-const FMIDIPacket& FMIDIBuffer::operator[](int32 index) const
+FMIDIPacket FMIDIBuffer::operator[](int32 index) const
 {
-    return Packets[index];
+    const auto& e = At(index);
+    if (e.Length == LongLength) {
+        const int32 offset = e.Data[0] | (e.Data[1] << 8) | (e.Data[2] << 16);
+        uint32 length = 0;
+        FMemory::Memcpy(&length, Payloads.GetData() + offset, sizeof(length));
+        return FMIDIPacket(FrameOf(e), length, Payloads.GetData() + offset + sizeof(length));
+    }
+    return FMIDIPacket(FrameOf(e), e.Length, e.Data.data());
 }
 
 void FMIDIBuffer::Push(FMIDIPacket packet)
 {
+    // a long message read from this buffer points into Payloads, which growing moves, keep its offset instead
+    const bool bLong = packet.Length() > packet.Data().size();
+    const uint8_t* base = Payloads.GetData();
+    const int64 aliased = bLong && packet.Bytes() >= base && packet.Bytes() < base + Payloads.Num() ? packet.Bytes() - base : INDEX_NONE;
+
+    if (bLong && !HasPayloadRoom(packet.Length())) {
+        Dropped++;
+        return;
+    }
+    if (!MakeRoom(1, &packet)) {
+        return;
+    }
+    if (aliased != INDEX_NONE) {
+        // dropping packets may also have freed the arena, Insert copies with that in mind
+        packet = FMIDIPacket(packet.Frame(), packet.Length(), Payloads.GetData() + aliased);
+    }
+
     auto frame = packet.Frame();
     if (frame < NumFramesPerBlock) {
         CountInBlock++;
     }
 
     // simple push back or insertion sort
-    if (frame >= LastFrame) {
-        LastFrame = frame;
-        Packets.Push(packet);
+    // new packets at the same frame will always come last
+    if (Count == 0 || FrameOf(At(Count - 1)) <= frame) {
+        Insert(Count, packet);
     }
     else {
-        // insertion sort
-        auto cnt = Packets.Num();
-        for (auto i = 0; i < cnt; i++) {
-            // insert before a packet that has a larger frame
-            // new packets at the same frame will always come last
-            // since the above if failed, we know this will never be the last packet
-            // so we will always have an insert
-            if (Packets[i].Frame() > frame) {
-                Packets.Insert(packet, i);
-                return;
-            }
-        }
-        // assert false?
+        Insert(UpperBound(frame), packet);
     }
 }
 
@@ -170,63 +250,458 @@ void FMIDIBuffer::PushNote(int32 start, int32 dur, uint8_t chan, uint8_t note, u
      *    * on and off come between our new on and off, move old off right before our new on
      *
      */
-    const auto count = Packets.Num();
+    if (Notes.Num() == 0) {
+        ReserveNotes();
+    }
+    // our on and off, any off we move takes its own slot back
+    if (!MakeRoom(2, nullptr)) {
+        return;
+    }
+    chan &= 0x0F;
+    note &= 0x7F;
+    // note times are compared as signed differences to the block start, keep them well within range
+    dur = std::min(dur, MaxNoteFrames);
+
+    // the last note on the same channel and number is the only one we can overlap
+    const uint16 index = chan * 128 + note;
+    auto& state = Notes[index];
     const auto end = start + dur;
-    for (auto i = 0; i < count; i++) {
-        auto& p = Packets[i];
-        const auto f = p.Frame();
-        if (f < start) {
-            continue;
-        }
-        // in range
-        if (p.IsNoteOn(chan, note)) {
+    if (state.bActive && FrameOf(state.OffTime) > start) {
+        const auto on = FrameOf(state.OnTime);
+        if (on >= start) {
             // existing note starts before our note ends, we need to shorten our note
-            if (f < end) {
+            const int32 i = on < end ? Find(on, 0x90 | chan, note) : INDEX_NONE;
+            if (i != INDEX_NONE) {
                 // insert our Off before the existing On, updated time
-                Packets.Insert(FMIDIPacket::NoteOff(f, note, offvel, chan), i);
+                Insert(i, FMIDIPacket::NoteOff(on, note, offvel, chan));
                 // adjust count
-                if (f < NumFramesPerBlock) {
+                if (on < NumFramesPerBlock) {
                     CountInBlock++;
                 }
-                // push our on after so we don't screw up above index
                 Push(FMIDIPacket::NoteOn(start, note, onvel, chan));
                 return;
             }
-            else {
-                break;
-            }
         }
-        else if (p.IsNoteOff(chan, note) && f > start) {
-            // should only hit this case if a note on isn't found either within the new note bounds or after it.
+        else if (state.OffIndex != INDEX_NONE) {
             // our new note either spans the off of an existing on note or is contained within an existing note
             // move the off just before our on
-            auto off = p.CloneTo(start);
-            Packets.RemoveAt(i);
-
-            // adjust count
-            if (f < NumFramesPerBlock) {
-                CountInBlock--; // will get incremented in the Push below
-            }
-            // adjust last frame
-            if (Packets.Num() > 0) {
-                LastFrame = Packets.Last(0).Frame();
-            }
-            else {
-                LastFrame = -1;
+            const auto vel = PendingOffs[state.OffIndex].Velocity;
+            RemoveOff(state.OffIndex);
+            Push(FMIDIPacket::NoteOff(start, note, vel, chan)); // XXX assumes there isn't another matching On at the exact time
+        }
+        else {
+            // same, with the off already in this block
+            const auto f = FrameOf(state.OffTime);
+            const int32 i = Find(f, 0x80 | chan, note);
+            if (i != INDEX_NONE) {
+                auto off = (*this)[i].CloneTo(start);
+                RemoveAt(i);
+                // adjust count
+                if (f < NumFramesPerBlock) {
+                    CountInBlock--; // will get incremented in the Push below
+                }
+                Push(off);
             }
-            Push(off); // XXX assumes there isn't another matching On at the exact time
-            break;
         }
     }
 
+    state.OnTime = BlockStart + static_cast<uint32>(start);
+    state.OffTime = BlockStart + static_cast<uint32>(end);
+    state.bActive = true;
+
     Push(FMIDIPacket::NoteOn(start, note, onvel, chan));
-    Push(FMIDIPacket::NoteOff(end, note, offvel, chan));
+    if (end >= NumFramesPerBlock) {
+        PushOff(index, state.OffTime, offvel);
+    }
+    else {
+        Push(FMIDIPacket::NoteOff(end, note, offvel, chan));
+    }
 }
 
 void FMIDIBuffer::Reset()
 {
-    Packets.Reset();
+    Head = 0;
+    Count = 0;
     CountInBlock = 0;
+    PayloadsUsed = 0;
+    NumLong = 0;
+    Notes.Reset();
+    PendingOffs.Reset();
+    Dropped = 0;
+    DroppedReported = 0;
+    Peak = 0;
+}
+
+void FMIDIBuffer::ReserveNotes()
+{
+    if (Notes.Num() == 0) {
+        Notes.SetNum(16 * 128);
+    }
+    // there is at most one pending off per note
+    PendingOffs.Reserve(16 * 128);
+    DueOffs.Reserve(16 * 128);
+}
+
+int32 FMIDIBuffer::NumDropped() const
+{
+    return Dropped;
+}
+
+int32 FMIDIBuffer::PeakNum() const
+{
+    return Peak;
+}
+
+bool FMIDIBuffer::MakeRoom(int32 num, const FMIDIPacket* packet)
+{
+    // pending offs are merged into the ring without checking, keep room for them
+    const int32 over = Count + PendingOffs.Num() + num - Events.Num();
+    if (over <= 0) {
+        return true;
+    }
+    if (!bFixedCapacity) {
+        Grow(Count + PendingOffs.Num() + num);
+        return true;
+    }
+
+    switch (Policy) {
+        case EMIDIOverflowPolicy::DropOldest:
+            if (DropOldest(over)) {
+                return true;
+            }
+            break;
+        case EMIDIOverflowPolicy::Coalesce:
+            if (packet != nullptr && over == 1) {
+                const int32 i = FindCoalescable(*packet);
+                if (i != INDEX_NONE) {
+                    RemoveAt(i);
+                    if (i < CountInBlock) {
+                        CountInBlock--;
+                    }
+                    Dropped++;
+                    return true;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    Dropped += num;
+    return false;
+}
+
+void FMIDIBuffer::ForgetNote(const FEvent& e)
+{
+    // the off PushNote scheduled for the last note is going out, nothing can overlap that note anymore
+    if (e.Length != 3 || (e.Data[0] & 0xF0) != 0x80 || Notes.Num() == 0) {
+        return;
+    }
+    auto& state = Notes[(e.Data[0] & 0x0F) * 128 + (e.Data[1] & 0x7F)];
+    if (state.bActive && state.OffIndex == INDEX_NONE && state.OffTime == e.Time) {
+        state.bActive = false;
+    }
+}
+
+bool FMIDIBuffer::DropOldest(int32 num)
+{
+    // notes are kept: dropping an off could leave a note hanging, and dropping an on would need its off, which may
+    // be shared with an overlapping note, dropped too
+    int32 end = 0;
+    int32 found = 0;
+    while (end < Count && found < num) {
+        if (!IsNote(At(end++))) {
+            found++;
+        }
+    }
+    if (found < num) {
+        return false;
+    }
+
+    // move the notes we keep up against the packets after the dropped ones, in order
+    int32 w = end;
+    int32 droppedInBlock = 0;
+    for (int32 r = end - 1; r >= 0; r--) {
+        const FEvent e = At(r);
+        if (IsNote(e)) {
+            At(--w) = e;
+            continue;
+        }
+        Forget(r);
+        if (r < CountInBlock) {
+            droppedInBlock++;
+        }
+    }
+
+    Head = (Head + w) & (Events.Num() - 1);
+    Count -= w;
+    CountInBlock -= droppedInBlock;
+    Dropped += w;
+    return true;
+}
+
+bool FMIDIBuffer::IsNote(const FEvent& e)
+{
+    const uint8_t status = e.Data[0] & 0xF0;
+    return e.Length == 3 && (status == 0x80 || status == 0x90);
+}
+
+bool FMIDIBuffer::HasPayloadRoom(size_t length)
+{
+    const size_t needed = static_cast<size_t>(PayloadsUsed) + sizeof(uint32) + length;
+    if (needed > static_cast<size_t>(MaxPayloadBytes)) {
+        return false;
+    }
+    if (needed > static_cast<size_t>(Payloads.Num())) {
+        if (bFixedCapacity) {
+            return false;
+        }
+        Payloads.SetNumUninitialized(std::min(std::max(static_cast<int32>(needed), Payloads.Num() * 2), MaxPayloadBytes));
+    }
+    return true;
+}
+
+void FMIDIBuffer::Forget(int32 index)
+{
+    // nothing refers to the arena anymore, start over
+    if (At(index).Length == LongLength && --NumLong == 0) {
+        PayloadsUsed = 0;
+    }
+}
+
+int32 FMIDIBuffer::FindCoalescable(const FMIDIPacket& packet) const
+{
+    const auto& data = packet.Data();
+    const uint8_t status = data[0];
+    bool bMatchData1 = false;
+    switch (status & 0xF0) {
+        case 0xA0: // poly pressure
+        case 0xB0: // control change
+            bMatchData1 = true;
+            break;
+        case 0xC0: // program change
+        case 0xD0: // channel pressure
+        case 0xE0: // pitch bend
+            break;
+        default:
+            return INDEX_NONE;
+    }
+
+    // the latest value is the one that matters
+    for (int32 i = Count - 1; i >= 0; i--) {
+        const auto& e = At(i);
+        if (e.Length == packet.Length() && e.Data[0] == status && (!bMatchData1 || e.Data[1] == data[1])) {
+            return i;
+        }
+    }
+    return INDEX_NONE;
+}
+
+int32 FMIDIBuffer::UpperBound(int32 frame) const
+{
+    int32 lo = 0;
+    int32 hi = Count;
+    while (lo < hi) {
+        const int32 mid = lo + (hi - lo) / 2;
+        if (FrameOf(At(mid)) <= frame) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int32 FMIDIBuffer::Find(int32 frame, uint8_t status, uint8_t note) const
+{
+    for (int32 i = UpperBound(frame - 1); i < Count && FrameOf(At(i)) == frame; i++) {
+        const auto& e = At(i);
+        if (e.Length == 3 && e.Data[0] == status && e.Data[1] == note) {
+            return i;
+        }
+    }
+    return INDEX_NONE;
+}
+
+void FMIDIBuffer::Insert(int32 index, const FMIDIPacket& packet)
+{
+    if (Count == Events.Num()) {
+        Grow(Count + 1);
+    }
+    Peak = std::max(Peak, Count + 1 + PendingOffs.Num());
+
+    const int32 mask = Events.Num() - 1;
+    if (index < Count - index) {
+        // move the packets before index down a slot
+        Head = (Head - 1) & mask;
+        for (int32 i = 0; i < index; i++) {
+            At(i) = At(i + 1);
+        }
+    }
+    else {
+        // move the packets from index up a slot
+        for (int32 i = Count; i > index; i--) {
+            At(i) = At(i - 1);
+        }
+    }
+    Count++;
+
+    auto& e = At(index);
+    e.Time = BlockStart + static_cast<uint32>(packet.Frame());
+    if (packet.Length() > e.Data.size()) {
+        // the caller checked HasPayloadRoom. The bytes may come from this arena, the copy can overlap them, and the
+        // length is written last so it can't overwrite them first
+        const uint32 length = static_cast<uint32>(packet.Length());
+        const int32 offset = PayloadsUsed;
+        FMemory::Memmove(Payloads.GetData() + offset + sizeof(length), packet.Bytes(), length);
+        FMemory::Memcpy(Payloads.GetData() + offset, &length, sizeof(length));
+        PayloadsUsed += static_cast<int32>(sizeof(length) + length);
+        NumLong++;
+
+        e.Data = { static_cast<uint8_t>(offset), static_cast<uint8_t>(offset >> 8), static_cast<uint8_t>(offset >> 16) };
+        e.Length = LongLength;
+    }
+    else {
+        e.Data = packet.Data();
+        e.Length = static_cast<uint8_t>(packet.Length());
+    }
+}
+
+void FMIDIBuffer::RemoveAt(int32 index)
+{
+    Forget(index);
+    const int32 mask = Events.Num() - 1;
+    if (index < Count - index - 1) {
+        for (int32 i = index; i > 0; i--) {
+            At(i) = At(i - 1);
+        }
+        Head = (Head + 1) & mask;
+    }
+    else {
+        for (int32 i = index; i < Count - 1; i++) {
+            At(i) = At(i + 1);
+        }
+    }
+    Count--;
+}
+
+void FMIDIBuffer::Grow(int32 MinSize)
+{
+    int32 size = std::max(Events.Num(), 32);
+    while (size < MinSize) {
+        size *= 2;
+    }
+
+    TArray<FEvent> events;
+    events.SetNumUninitialized(size);
+    for (int32 i = 0; i < Count; i++) {
+        events[i] = At(i);
+    }
+    Events = MoveTemp(events);
+    Head = 0;
+}
+
+bool FMIDIBuffer::IsBefore(const FPendingOff& a, const FPendingOff& b) const
+{
+    const int32 fa = FrameOf(a.Time);
+    const int32 fb = FrameOf(b.Time);
+    return fa != fb ? fa < fb : static_cast<int32>(a.Seq - b.Seq) < 0;
+}
+
+void FMIDIBuffer::PushOff(uint16 note, uint32 time, uint8_t velocity)
+{
+    Peak = std::max(Peak, Count + PendingOffs.Num() + 1);
+    PendingOffs.AddUninitialized(1);
+    Place(PendingOffs.Num() - 1, { time, OffSeq++, note, velocity });
+    SiftUp(PendingOffs.Num() - 1);
+}
+
+void FMIDIBuffer::RemoveOff(int32 index)
+{
+    Notes[PendingOffs[index].Note].OffIndex = INDEX_NONE;
+    const auto last = PendingOffs.Pop(false);
+    if (index < PendingOffs.Num()) {
+        Place(index, last);
+        SiftUp(index);
+        SiftDown(Notes[last.Note].OffIndex);
+    }
+}
+
+void FMIDIBuffer::SiftUp(int32 index)
+{
+    const auto off = PendingOffs[index];
+    while (index > 0) {
+        const int32 parent = (index - 1) / 2;
+        if (!IsBefore(off, PendingOffs[parent])) {
+            break;
+        }
+        Place(index, PendingOffs[parent]);
+        index = parent;
+    }
+    Place(index, off);
+}
+
+void FMIDIBuffer::SiftDown(int32 index)
+{
+    const auto off = PendingOffs[index];
+    const int32 num = PendingOffs.Num();
+    while (true) {
+        int32 child = index * 2 + 1;
+        if (child >= num) {
+            break;
+        }
+        if (child + 1 < num && IsBefore(PendingOffs[child + 1], PendingOffs[child])) {
+            child++;
+        }
+        if (!IsBefore(PendingOffs[child], off)) {
+            break;
+        }
+        Place(index, PendingOffs[child]);
+        index = child;
+    }
+    Place(index, off);
+}
+
+void FMIDIBuffer::Place(int32 index, const FPendingOff& off)
+{
+    PendingOffs[index] = off;
+    Notes[off.Note].OffIndex = index;
+}
+
+void FMIDIBuffer::MergeDueOffs()
+{
+    DueOffs.Reset();
+    while (PendingOffs.Num() > 0 && FrameOf(PendingOffs[0].Time) < NumFramesPerBlock) {
+        DueOffs.Add(PendingOffs[0]);
+        RemoveOff(0);
+    }
+    const int32 num = DueOffs.Num();
+    if (num == 0) {
+        return;
+    }
+
+    if (Count + num > Events.Num()) {
+        Grow(Count + num);
+    }
+
+    // merge them with the packets of this block, which move down to make room
+    // offs were pushed before the packets at the same frame, PushNote leaves nothing past the current block in the ring
+    const int32 mask = Events.Num() - 1;
+    Head = (Head - num) & mask;
+    int32 r = num;
+    int32 o = 0;
+    for (const auto& off : DueOffs) {
+        const int32 f = FrameOf(off.Time);
+        while (r < CountInBlock + num && FrameOf(At(r)) < f) {
+            At(o++) = At(r++);
+        }
+        auto& e = At(o++);
+        e.Time = off.Time;
+        e.Data = { static_cast<uint8_t>(0x80 | (off.Note / 128)), static_cast<uint8_t>(off.Note % 128), off.Velocity };
+        e.Length = 3;
+    }
+    Count += num;
+    CountInBlock += num;
 }
 
 } // namespace RNBOMetasound
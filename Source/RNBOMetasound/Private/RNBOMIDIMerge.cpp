@@ -2,6 +2,7 @@
 #include "RNBONode.h"
 #include <vector>
 #include <array>
+#include <limits>
 
 #include "MetasoundParamHelper.h"
 #include "MetasoundDataReferenceMacro.h"
@@ -18,7 +19,9 @@ using namespace RNBOMetasound;
 
 namespace {
 
-const std::array<const TCHAR*, 8> InputNames = {
+constexpr size_t MaxInputs = 16;
+
+const std::array<const TCHAR*, MaxInputs> InputNames = {
     TEXT("In 1"),
     TEXT("In 2"),
     TEXT("In 3"),
@@ -27,8 +30,16 @@ const std::array<const TCHAR*, 8> InputNames = {
     TEXT("In 6"),
     TEXT("In 7"),
     TEXT("In 8"),
+    TEXT("In 9"),
+    TEXT("In 10"),
+    TEXT("In 11"),
+    TEXT("In 12"),
+    TEXT("In 13"),
+    TEXT("In 14"),
+    TEXT("In 15"),
+    TEXT("In 16"),
 };
-const std::array<const FText, 8> InputToolTips = {
+const std::array<const FText, MaxInputs> InputToolTips = {
     LOCTEXT("ParamMIDIMergeIn1ToolTip", "MIDI Input 1"),
     LOCTEXT("ParamMIDIMergeIn2ToolTip", "MIDI Input 2"),
     LOCTEXT("ParamMIDIMergeIn3ToolTip", "MIDI Input 3"),
@@ -37,8 +48,16 @@ const std::array<const FText, 8> InputToolTips = {
     LOCTEXT("ParamMIDIMergeIn6ToolTip", "MIDI Input 6"),
     LOCTEXT("ParamMIDIMergeIn7ToolTip", "MIDI Input 7"),
     LOCTEXT("ParamMIDIMergeIn8ToolTip", "MIDI Input 8"),
+    LOCTEXT("ParamMIDIMergeIn9ToolTip", "MIDI Input 9"),
+    LOCTEXT("ParamMIDIMergeIn10ToolTip", "MIDI Input 10"),
+    LOCTEXT("ParamMIDIMergeIn11ToolTip", "MIDI Input 11"),
+    LOCTEXT("ParamMIDIMergeIn12ToolTip", "MIDI Input 12"),
+    LOCTEXT("ParamMIDIMergeIn13ToolTip", "MIDI Input 13"),
+    LOCTEXT("ParamMIDIMergeIn14ToolTip", "MIDI Input 14"),
+    LOCTEXT("ParamMIDIMergeIn15ToolTip", "MIDI Input 15"),
+    LOCTEXT("ParamMIDIMergeIn16ToolTip", "MIDI Input 16"),
 };
-const std::array<const FText, 8> InputDisplayNames = {
+const std::array<const FText, MaxInputs> InputDisplayNames = {
     LOCTEXT("ParamMIDIMergeIn1DisplayName", "In 1"),
     LOCTEXT("ParamMIDIMergeIn2DisplayName", "In 2"),
     LOCTEXT("ParamMIDIMergeIn3DisplayName", "In 3"),
@@ -47,15 +66,96 @@ const std::array<const FText, 8> InputDisplayNames = {
     LOCTEXT("ParamMIDIMergeIn6DisplayName", "In 6"),
     LOCTEXT("ParamMIDIMergeIn7DisplayName", "In 7"),
     LOCTEXT("ParamMIDIMergeIn8DisplayName", "In 8"),
+    LOCTEXT("ParamMIDIMergeIn9DisplayName", "In 9"),
+    LOCTEXT("ParamMIDIMergeIn10DisplayName", "In 10"),
+    LOCTEXT("ParamMIDIMergeIn11DisplayName", "In 11"),
+    LOCTEXT("ParamMIDIMergeIn12DisplayName", "In 12"),
+    LOCTEXT("ParamMIDIMergeIn13DisplayName", "In 13"),
+    LOCTEXT("ParamMIDIMergeIn14DisplayName", "In 14"),
+    LOCTEXT("ParamMIDIMergeIn15DisplayName", "In 15"),
+    LOCTEXT("ParamMIDIMergeIn16DisplayName", "In 16"),
 };
 
 METASOUND_PARAM(ParamMIDIMergeMIDI, "Out", "The merged MIDI.")
 
 } // namespace
 
+// Everything but the vertex interface, shared by all input counts
+class FMIDIMergeOperator : public TExecutableOperator<FMIDIMergeOperator>
+{
+  public:
+    FMIDIMergeOperator(
+        size_t NumInputs,
+        const FOperatorSettings& InSettings,
+        const FDataReferenceCollection& InputCollection)
+        // room for everything the inputs can hold
+        : MIDIOut(FMIDIBufferWriteRef::CreateNew(
+            InSettings,
+            FMIDIBuffer::DefaultCapacity() * static_cast<int32>(NumInputs),
+            FMIDIBuffer::DefaultPayloadBytes() * static_cast<int32>(NumInputs),
+            FMIDIBuffer::DefaultOverflowPolicy()))
+        , Cursors(NumInputs, 0)
+        , Heads(NumInputs, 0)
+    {
+        for (size_t i = 0; i < NumInputs; i++) {
+            MIDIIn.push_back(InputCollection.GetDataReadReferenceOrConstruct<FMIDIBuffer>(InputNames[i], InSettings));
+        }
+    }
+
+    virtual void BindInputs(FInputVertexInterfaceData& InOutVertexData) override
+    {
+        for (size_t i = 0; i < MIDIIn.size(); i++) {
+            InOutVertexData.BindReadVertex(InputNames[i], MIDIIn[i]);
+        }
+    }
+
+    virtual void BindOutputs(FOutputVertexInterfaceData& InOutVertexData) override
+    {
+        InOutVertexData.BindReadVertex(METASOUND_GET_PARAM_NAME(ParamMIDIMergeMIDI), MIDIOut);
+    }
+
+    void Execute()
+    {
+        MIDIOut->AdvanceBlock();
+
+        // each input is in time order, so is the output if we always take the earliest packet left, from the lowest
+        // input on ties, and then every push is an append
+        constexpr int32 Done = std::numeric_limits<int32>::max();
+        const size_t num = MIDIIn.size();
+        for (size_t i = 0; i < num; i++) {
+            Cursors[i] = 0;
+            Heads[i] = MIDIIn[i]->NumInBlock() > 0 ? (*MIDIIn[i])[0].Frame() : Done;
+        }
+
+        while (true) {
+            size_t next = 0;
+            for (size_t i = 1; i < num; i++) {
+                if (Heads[i] < Heads[next]) {
+                    next = i;
+                }
+            }
+            if (Heads[next] == Done) {
+                break;
+            }
+
+            const auto& m = *MIDIIn[next];
+            MIDIOut->Push(m[Cursors[next]++]);
+            Heads[next] = Cursors[next] < m.NumInBlock() ? m[Cursors[next]].Frame() : Done;
+        }
+    }
+
+  private:
+    FMIDIBufferWriteRef MIDIOut;
+    std::vector<FMIDIBufferReadRef> MIDIIn;
+    std::vector<int32> Cursors;
+    std::vector<int32> Heads; // frame of the next packet of each input
+};
+
 template <size_t N>
-class FMIDIMergeOperator : public TExecutableOperator<FMIDIMergeOperator<N>>
+class TMIDIMergeOperator : public FMIDIMergeOperator
 {
+    static_assert(N <= MaxInputs, "add input names");
+
   public:
     static const FNodeClassMetadata& GetNodeInfo()
     {
@@ -108,79 +208,36 @@ class FMIDIMergeOperator : public TExecutableOperator<FMIDIMergeOperator<N>>
 
     static TUniquePtr<IOperator> CreateOperator(const FCreateOperatorParams& InParams, FBuildErrorArray& OutErrors)
     {
-        const FDataReferenceCollection& InputCollection = InParams.InputDataReferences;
-        const FInputVertexInterface& InputInterface = GetVertexInterface().GetInputInterface();
-
-        return MakeUnique<FMIDIMergeOperator<N>>(InParams, InParams.OperatorSettings, InputCollection, InputInterface, OutErrors);
-    }
-
-    FMIDIMergeOperator(
-        const FCreateOperatorParams& InParams,
-        const FOperatorSettings& InSettings,
-        const FDataReferenceCollection& InputCollection,
-        const FInputVertexInterface& InputInterface,
-        FBuildErrorArray& OutErrors)
-        : MIDIOut(FMIDIBufferWriteRef::CreateNew(InSettings))
-    {
-        for (size_t i = 0; i < N; i++) {
-            MIDIIn.push_back(InputCollection.GetDataReadReferenceOrConstruct<FMIDIBuffer>(InputNames[i], InSettings));
-        }
-    }
-
-    virtual void BindInputs(FInputVertexInterfaceData& InOutVertexData) override
-    {
-        for (size_t i = 0; i < N; i++) {
-            InOutVertexData.BindReadVertex(InputNames[i], MIDIIn[i]);
-        }
-    }
-
-    virtual void BindOutputs(FOutputVertexInterfaceData& InOutVertexData) override
-    {
-        InOutVertexData.BindReadVertex(METASOUND_GET_PARAM_NAME(ParamMIDIMergeMIDI), MIDIOut);
+        return MakeUnique<TMIDIMergeOperator<N>>(InParams.OperatorSettings, InParams.InputDataReferences);
     }
 
-    void Execute()
+    TMIDIMergeOperator(const FOperatorSettings& InSettings, const FDataReferenceCollection& InputCollection)
+        : FMIDIMergeOperator(N, InSettings, InputCollection)
     {
-        MIDIOut->AdvanceBlock();
-        for (auto& m : MIDIIn) {
-            for (int32 i = 0; i < m->NumInBlock(); i++) {
-                MIDIOut->Push((*m)[i]);
-            }
-        }
     }
-
-  private:
-    FMIDIBufferWriteRef MIDIOut;
-    std::vector<FMIDIBufferReadRef> MIDIIn;
 };
 
 #undef LOCTEXT_NAMESPACE
 
-template class FMIDIMergeOperator<2>;
-using MIDIMergeOperatorNode2 = FGenericNode<FMIDIMergeOperator<2>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode2)
-
-template class FMIDIMergeOperator<3>;
-using MIDIMergeOperatorNode3 = FGenericNode<FMIDIMergeOperator<3>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode3)
-
-template class FMIDIMergeOperator<4>;
-using MIDIMergeOperatorNode4 = FGenericNode<FMIDIMergeOperator<4>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode4)
-
-template class FMIDIMergeOperator<5>;
-using MIDIMergeOperatorNode5 = FGenericNode<FMIDIMergeOperator<5>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode5)
-
-template class FMIDIMergeOperator<6>;
-using MIDIMergeOperatorNode6 = FGenericNode<FMIDIMergeOperator<6>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode6)
-
-template class FMIDIMergeOperator<7>;
-using MIDIMergeOperatorNode7 = FGenericNode<FMIDIMergeOperator<7>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode7)
-
-template class FMIDIMergeOperator<8>;
-using MIDIMergeOperatorNode8 = FGenericNode<FMIDIMergeOperator<8>>;
-METASOUND_REGISTER_NODE(MIDIMergeOperatorNode8)
+#define RNBO_REGISTER_MIDI_MERGE(N)                                           \
+    using MIDIMergeOperatorNode##N = FGenericNode<TMIDIMergeOperator<N>>; \
+    METASOUND_REGISTER_NODE(MIDIMergeOperatorNode##N)
+
+RNBO_REGISTER_MIDI_MERGE(2)
+RNBO_REGISTER_MIDI_MERGE(3)
+RNBO_REGISTER_MIDI_MERGE(4)
+RNBO_REGISTER_MIDI_MERGE(5)
+RNBO_REGISTER_MIDI_MERGE(6)
+RNBO_REGISTER_MIDI_MERGE(7)
+RNBO_REGISTER_MIDI_MERGE(8)
+RNBO_REGISTER_MIDI_MERGE(9)
+RNBO_REGISTER_MIDI_MERGE(10)
+RNBO_REGISTER_MIDI_MERGE(11)
+RNBO_REGISTER_MIDI_MERGE(12)
+RNBO_REGISTER_MIDI_MERGE(13)
+RNBO_REGISTER_MIDI_MERGE(14)
+RNBO_REGISTER_MIDI_MERGE(15)
+RNBO_REGISTER_MIDI_MERGE(16)
+
+#undef RNBO_REGISTER_MIDI_MERGE
 } // namespace
@@ -101,6 +101,7 @@ class FMakeNoteOperator : public TExecutableOperator<FMakeNoteOperator>
 
         , MIDIOut(FMIDIBufferWriteRef::CreateNew(InSettings))
     {
+        MIDIOut->ReserveNotes();
     }
 
     virtual void BindInputs(FInputVertexInterfaceData& InOutVertexData) override
@@ -1,6 +1,7 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "RNBOMetasound.h"
+#include "RNBOBufferCache.h"
 #include "RNBOTransport.h"
 #include "MetasoundFrontendRegistries.h"
 
@@ -14,6 +15,7 @@ void FRNBOMetasoundModule::ShutdownModule()
 {
     // This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
     // we call this function before unloading the module.
+    RNBOMetasound::FWaveBufferCache::Get().Shutdown();
 }
 
 IMPLEMENT_MODULE(FRNBOMetasoundModule, RNBOMetasound)
@@ -1,10 +1,19 @@
 #pragma once
 
 #include "RNBOOperator.h"
+#include "RNBOBufferCache.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/Paths.h"
 
 namespace {
-UE::Tasks::FPipe AsyncTaskPipe{ TEXT("RNBODatarefLoader") };
-FCriticalSection AsyncTaskPipeMutex;
+int32 ReleaseOnRetarget = 1;
+FAutoConsoleVariableRef CVarReleaseOnRetarget(
+    TEXT("au.RNBO.WaveBufferCache.ReleaseOnRetarget"),
+    ReleaseOnRetarget,
+    TEXT("Release the buffer~ data bound to an RNBO node as soon as its WaveAsset pin changes, instead of when the new wave is bound, so both are never resident at once.\n"),
+    ECVF_Default);
 } // namespace
 
 namespace RNBOMetasound {
@@ -13,297 +22,165 @@ WaveAssetDataRef::WaveAssetDataRef(
     RNBO::CoreObject& coreObject,
     const char* id,
     const TCHAR* Name,
+    const TCHAR* ClassName,
+    const FDecodedWavePtr& defaultWave,
     const Metasound::FOperatorSettings& InSettings,
     const Metasound::FDataReferenceCollection& InputCollection)
     : CoreObject(coreObject)
     , Id(id)
     , WaveAsset(InputCollection.GetDataReadReferenceOrConstruct<Metasound::FWaveAsset>(Name))
+    , SampleRate(InSettings.GetSampleRate())
+    // every instance starts from the imported samples, not from what another instance wrote into them
+    , Default(FWaveBufferCache::ShareBoundData() ? defaultWave : FWaveBufferCache::MakePrivate(defaultWave))
+    , Request(MakeShared<FWaveRequest, ESPMode::ThreadSafe>(&coreObject, ClassName))
 {
+    FWaveBufferCache::Get().AddRequest(Request);
 }
 
 WaveAssetDataRef::~WaveAssetDataRef()
 {
-    Cleanup.Push(Task);
-    for (auto& t : Cleanup) {
-        if (t.IsValid() && !t.IsCompleted()) {
-            t.BusyWait();
-        }
-    }
+    CancelLoad();
+    Request->Drop();
+    // the core object releases the data when it is reset or deleted
+    SetBoundBytes(0);
 }
 
-void WaveAssetDataRef::Update()
+void WaveAssetDataRef::Bind(FDecodedWavePtr Wave)
 {
-    auto WaveProxy = WaveAsset->GetSoundWaveProxy();
-    if (WaveProxy.IsValid()) {
-        auto key = WaveProxy->GetFObjectKey();
-        if (key == WaveAssetProxyKey) {
-            return;
-        }
-        WaveAssetProxyKey = key;
-
-        // TODO remove completed tasks from Cleanup
-        // TODO optionally release the existing dataref from the core object to reduce memory usage?
-
-        if (Task.IsValid() && !Task.IsCompleted()) {
-            Cleanup.Push(Task);
-        }
-
-        {
-            // Launch probably isn't thread safe so we lock a mutex
-            FScopeLock Guard(&AsyncTaskPipeMutex);
-            Task = AsyncTaskPipe.Launch(
-                UE_SOURCE_LOCATION,
-                [this, WaveProxy]() {
-                    double sr = WaveProxy->GetSampleRate();
-                    size_t chans = WaveProxy->GetNumChannels();
-                    // int32 frames = WaveProxy->GetNumFrames();
-                    // double duration = WaveProxy->GetDuration();
-
-                    FName Format = WaveProxy->GetRuntimeFormat();
-                    IAudioInfoFactory* Factory = IAudioInfoFactoryRegistry::Get().Find(Format);
-                    if (Factory == nullptr) {
-                        UE_LOG(LogMetaSound, Error, TEXT("IAudioInfoFactoryRegistry::Get().Find(%s) failed"), Format);
-                        return;
-                    }
-
-                    ICompressedAudioInfo* Decompress = Factory->Create();
-                    FSoundQualityInfo quality;
-                    TArray<uint8> Buf;
-                    int32 ValidBytes = 0;
-                    if (WaveProxy->IsStreaming()) {
-                        if (!Decompress->StreamCompressedInfo(WaveProxy, &quality)) {
-                            UE_LOG(LogMetaSound, Error, TEXT("RNBO Failed to get compressed stream info"));
-                            return;
-                        }
-                        Buf.AddZeroed(quality.SampleDataSize);
-                        Decompress->StreamCompressedData(Buf.GetData(), false, Buf.Num(), ValidBytes);
-                    }
-                    else {
-                        if (!Decompress->ReadCompressedInfo(WaveProxy->GetResourceData(), WaveProxy->GetResourceSize(), &quality)) {
-                            UE_LOG(LogMetaSound, Error, TEXT("RNBO Failed to get compressed info"));
-                            return;
-                        }
-                        Buf.AddZeroed(quality.SampleDataSize);
-                        if (Decompress->ReadCompressedData(Buf.GetData(), false, Buf.Num())) {
-                            ValidBytes = Buf.Num();
-                        }
-                        else {
-                            UE_LOG(LogMetaSound, Error, TEXT("RNBO Failed to read compressed data"));
-                            return;
-                        }
-                    }
-
-                    TArrayView<const int16> Data(reinterpret_cast<const int16*>(Buf.GetData()), Buf.Num() / sizeof(int16));
+    // decoded samples are on the heap and mapped ones are copy on write, the patch may write into either. The wave
+    // is this dataref's own copy unless au.RNBO.WaveBufferCache.ShareBoundData is set, the cache won't retain it then
+    Wave->bBoundWritable.store(true, std::memory_order_relaxed);
+    char* DataPtr = reinterpret_cast<char*>(const_cast<float*>(Wave->GetData()));
+    size_t SizeInBytes = Wave->SizeInBytes();
+    SetBoundBytes(SizeInBytes);
 
-                    TSharedPtr<TArray<float>> Samples(new TArray<float>());
-                    Samples->Reserve(Data.Num());
-
-                    const float div = static_cast<float>(INT16_MAX);
-                    for (auto i = 0; i < Data.Num(); i++) {
-                        Samples->Push(static_cast<float>(Data[i]) / div);
-                    }
-                    size_t SizeInBytes = Buf.Num();
-                    char* DataPtr = reinterpret_cast<char*>(Samples->GetData());
-
-                    RNBO::Float32AudioBuffer bufferType(chans, sr);
-                    CoreObject.setExternalData(Id, DataPtr, sizeof(float) * static_cast<size_t>(Samples->Num()), bufferType, [Samples](RNBO::ExternalDataId, char*) mutable {
-                        Samples.Reset();
-                    });
-                },
-                UE::Tasks::ETaskPriority::BackgroundNormal);
-        }
-    }
+    // the core object holds a reference to the wave until it releases the data, which can happen on the audio thread
+    RNBO::Float32AudioBuffer bufferType(Wave->NumChannels, Wave->SampleRate);
+    CoreObject.setExternalData(Id, DataPtr, SizeInBytes, bufferType, [Wave](RNBO::ExternalDataId, char*) mutable {
+        FWaveBufferCache::Get().Retire(MoveTemp(Wave));
+    });
 }
 
-bool IsBoolParam(const RNBO::Json& p)
+void WaveAssetDataRef::Release()
 {
-    if (p["steps"].get<int>() == 2 && p["enumValues"].is_array()) {
-        auto e = p["enumValues"];
-        return e[0].is_number() && e[1].is_number() && e[0].get<float>() == 0.0f && e[1].get<float>() == 1.0f;
-    }
-    return false;
+    CoreObject.releaseExternalData(Id);
+    SetBoundBytes(0);
 }
 
-bool IsIntParam(const RNBO::Json& p)
+void WaveAssetDataRef::SetBoundBytes(size_t Bytes)
 {
-    return !IsBoolParam(p) && p["isEnum"].get<bool>();
+    FWaveBufferCache::Get().AddBoundBytes(static_cast<int64>(Bytes) - static_cast<int64>(BoundBytes));
+    Request->SetBoundBytes(static_cast<int64>(Bytes));
+    BoundBytes = Bytes;
 }
 
-bool IsFloatParam(const RNBO::Json& p)
+void WaveAssetDataRef::CancelLoad()
 {
-    return !(IsBoolParam(p) || IsIntParam(p));
+    // anything posted for the previous load is stale now
+    Request->Cancel(++Generation);
 }
 
-bool IsInputParam(const RNBO::Json& p)
+void WaveAssetDataRef::BindPending()
 {
-    if (p["meta"].is_object() && p["meta"]["in"].is_boolean()) {
-        return p["meta"]["in"].get<bool>();
+    FDecodedWavePtr Wave;
+    uint32 PostedFor = 0;
+    if (!Request->Handoff.Take(Wave, PostedFor)) {
+        return;
     }
-    // default true
-    return true;
-}
-
-bool IsOutputParam(const RNBO::Json& p)
-{
-    if (p["meta"].is_object() && p["meta"]["out"].is_boolean()) {
-        return p["meta"]["out"].get<bool>();
+    if (PostedFor == Generation && Wave.IsValid()) {
+        Bind(MoveTemp(Wave));
+    }
+    else {
+        FWaveBufferCache::Get().Retire(MoveTemp(Wave));
     }
-    // default false
-    return false;
 }
 
-std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> FRNBOMetasoundParam::InportTrig(const RNBO::Json& desc)
+void WaveAssetDataRef::Update()
 {
-    std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> params;
-    for (auto& p : desc["inports"]) {
-        std::string tag = p["tag"];
-        std::string description = tag;
-        std::string displayName = tag;
-        if (p.contains("meta")) {
-            // TODO get description and display name
-
-            // TODO
-            /*
-               if (p["meta"].contains("trigger") && p["meta"]["trigger"].is_bool() && p["meta"]["trigger"].get<bool>()) {
-               }
-               */
+    auto WaveProxy = WaveAsset->GetSoundWaveProxy();
+    if (WaveProxy.IsValid()) {
+        auto key = WaveProxy->GetFObjectKey();
+        if (key == WaveAssetProxyKey) {
+            return;
         }
-        RNBO::MessageTag id = RNBO::TAG(tag.c_str());
-        params.emplace(
-            id,
-            FRNBOMetasoundParam(FString(tag.c_str()), FText::AsCultureInvariant(description.c_str()), FText::AsCultureInvariant(displayName.c_str())));
-    }
 
-    return params;
-}
+        const float Rate = FWaveBufferCache::ResampleRate(WaveProxy, SampleRate);
 
-std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> FRNBOMetasoundParam::OutportTrig(const RNBO::Json& desc)
-{
-    std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> params;
-    for (auto& p : desc["outports"]) {
-        std::string tag = p["tag"];
-        std::string description = tag;
-        std::string displayName = tag;
-        if (p.contains("meta")) {
-            // TODO get description and display name
-
-            // TODO
-            /*
-               if (p["meta"].contains("trigger") && p["meta"]["trigger"].is_bool() && p["meta"]["trigger"].get<bool>()) {
-               }
-               */
+        // already decoded, prefetched for instance: bind it right away when it can be shared, a private copy is made
+        // off this thread by the request
+        if (FDecodedWavePtr Wave = FWaveBufferCache::ShareBoundData() ? FWaveBufferCache::Get().Find(WaveProxy, Rate) : FDecodedWavePtr(); Wave.IsValid()) {
+            WaveAssetProxyKey = key;
+            // the previous wave isn't needed anymore, if nobody else wants it stop loading it
+            CancelLoad();
+            Bind(MoveTemp(Wave));
+            return;
         }
-        RNBO::MessageTag id = RNBO::TAG(tag.c_str());
-        params.emplace(
-            id,
-            FRNBOMetasoundParam(FString(tag.c_str()), FText::AsCultureInvariant(description.c_str()), FText::AsCultureInvariant(displayName.c_str())));
-    }
-
-    return params;
-}
 
-std::vector<FRNBOMetasoundParam> FRNBOMetasoundParam::InputAudio(const RNBO::Json& desc)
-{
-    // TODO param~
-    return Signals(desc, "inlets");
-}
+        // the cache starts the load off this thread and cancels the previous one, if it is reading the request right
+        // now try again on the next block
+        if (!Request->Post(WaveProxy, Rate, Generation + 1)) {
+            return;
+        }
+        WaveAssetProxyKey = key;
+        Generation++;
 
-std::vector<FRNBOMetasoundParam> FRNBOMetasoundParam::OutputAudio(const RNBO::Json& desc)
-{
-    return Signals(desc, "outlets");
+        // don't keep the old wave resident while the new one loads, its release callback retires it off this thread
+        if (ReleaseOnRetarget != 0 && BoundBytes > 0) {
+            Release();
+        }
+    }
 }
 
-std::vector<FRNBOMetasoundParam> FRNBOMetasoundParam::DataRef(const RNBO::Json& desc)
+void WaveAssetDataRef::BindDefault()
 {
-    std::vector<FRNBOMetasoundParam> params;
-    for (auto& p : desc["externalDataRefs"]) {
-        // only supporting buffer~ for now
-        if (p.contains("tag") && p["tag"].get<std::string>() != "buffer~") {
-            continue;
-        }
-        std::string id = p["id"];
-        std::string description = id;
-        std::string displayName = id;
-        params.emplace_back(FString(id.c_str()), FText::AsCultureInvariant(description.c_str()), FText::AsCultureInvariant(displayName.c_str()));
+    // a wave set on the pin replaces it once loaded
+    if (Default.IsValid()) {
+        Bind(Default);
     }
-
-    return params;
 }
 
-bool FRNBOMetasoundParam::MIDIIn(const RNBO::Json& desc)
+FDecodedWavePtr WaveAssetDataRef::MapImported(const TCHAR* File)
 {
-    return desc["numMidiInputPorts"].get<int>() > 0;
+    if (File == nullptr) {
+        return {};
+    }
+    TSharedPtr<IPlugin> Plugin = IPluginManager::Get().FindPlugin(TEXT("RNBOMetasound"));
+    if (!Plugin.IsValid()) {
+        return {};
+    }
+    // staged with the packaged plugin, or straight from the build's intermediate directory when running from source
+    FString Path = FPaths::Combine(Plugin->GetBaseDir(), TEXT("Resources"), FString(File));
+    if (!FPaths::FileExists(Path)) {
+        Path = FPaths::Combine(Plugin->GetBaseDir(), TEXT("Intermediate"), FString(File));
+    }
+    FDecodedWavePtr Wave = FWaveBufferCache::MapFile(Path);
+    if (!Wave.IsValid()) {
+        UE_LOG(LogMetaSound, Warning, TEXT("RNBO failed to map imported buffer~ data %s"), *Path);
+    }
+    return Wave;
 }
 
-bool FRNBOMetasoundParam::MIDIOut(const RNBO::Json& desc)
+FRNBOMetasoundParam FRNBOMetasoundParam::FromParam(const FRNBOExportParam& p)
 {
-    return desc["numMidiOutputPorts"].get<int>() > 0;
+    return FRNBOMetasoundParam(FString(p.Name), FText::AsCultureInvariant(FString(p.Id)), FText::AsCultureInvariant(FString(p.DisplayName)), p.InitialValue);
 }
 
-std::vector<FRNBOMetasoundParam> FRNBOMetasoundParam::Signals(const RNBO::Json& desc, std::string selector)
+FRNBOMetasoundParam FRNBOMetasoundParam::FromSignal(const FRNBOExportSignal& p)
 {
-    std::vector<FRNBOMetasoundParam> params;
-
-    const std::string sig("signal");
-    for (auto& p : desc[selector]) {
-        if (p.contains("type") && sig.compare(p["type"].get<std::string>()) == 0) {
-            std::string name = p["tag"].get<std::string>();
-            std::string tooltip = name;
-            std::string displayName = name;
-
-            // read comment and populate displayName if it exists
-            if (p.contains("comment") && p["comment"].is_string()) {
-                displayName = p["comment"].get<std::string>();
-            }
-            if (p.contains("meta") && p["meta"].is_object()) {
-                const RNBO::Json& meta = p["meta"];
-                if (meta.contains("displayname") && meta["displayname"].is_string()) {
-                    displayName = meta["displayname"].get<std::string>();
-                }
-                if (meta.contains("tooltip") && meta["tooltip"].is_string()) {
-                    tooltip = meta["tooltip"].get<std::string>();
-                }
-            }
-
-            params.emplace_back(FString(name.c_str()), FText::AsCultureInvariant(tooltip.c_str()), FText::AsCultureInvariant(displayName.c_str()), 0.0f);
-        }
-    }
-
-    return params;
+    return FRNBOMetasoundParam(FString(p.Name), FText::AsCultureInvariant(FString(p.Tooltip)), FText::AsCultureInvariant(FString(p.DisplayName)), 0.0f);
 }
 
-void FRNBOMetasoundParam::NumericParams(const RNBO::Json& desc, std::function<void(const RNBO::Json& param, RNBO::ParameterIndex index, const std::string& name, const std::string& displayName, const std::string& id)> func)
+FRNBOMetasoundParam FRNBOMetasoundParam::FromPort(const FRNBOExportPort& p)
 {
-    for (auto& p : desc["parameters"]) {
-        if (p["type"].get<std::string>().compare("ParameterTypeNumber") != 0) {
-            continue;
-        }
-        if (p.contains("visible") && p["visible"].get<bool>() == false) {
-            continue;
-        }
-        RNBO::ParameterIndex index = static_cast<RNBO::ParameterIndex>(p["index"].get<int>());
-        std::string name = p["name"].get<std::string>();
-        std::string displayName = p["displayName"].get<std::string>();
-        if (displayName.size() == 0) {
-            displayName = name;
-        }
-        std::string id = p["paramId"].get<std::string>();
-        func(p, index, name, displayName, id);
-    }
+    // TODO get description and display name from meta
+    FString name(p.Name);
+    return FRNBOMetasoundParam(name, FText::AsCultureInvariant(name), FText::AsCultureInvariant(name));
 }
 
-std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam> FRNBOMetasoundParam::NumericParamsFiltered(const RNBO::Json& desc, std::function<bool(const RNBO::Json& p)> filter)
+FRNBOMetasoundParam FRNBOMetasoundParam::FromDataRef(const FRNBOExportDataRef& p)
 {
-    std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam> params;
-    NumericParams(desc, [&params, &filter](const RNBO::Json& p, RNBO::ParameterIndex index, const std::string& name, const std::string& displayName, const std::string& id) {
-        if (filter(p)) {
-            float initialValue = p["initialValue"].get<float>();
-            params.emplace(
-                index,
-                FRNBOMetasoundParam(FString(name.c_str()), FText::AsCultureInvariant(id.c_str()), FText::AsCultureInvariant(displayName.c_str()), initialValue));
-        }
-    });
-    return params;
+    FString name(p.Name);
+    return FRNBOMetasoundParam(name, FText::AsCultureInvariant(name), FText::AsCultureInvariant(name));
 }
 
 } // namespace RNBOMetasound
@@ -3,6 +3,9 @@
 #include "RNBONode.h"
 #include "RNBOMIDI.h"
 #include "RNBOTransport.h"
+#include "RNBOCoreObjectPool.h"
+#include "RNBOBufferCache.h"
+#include "RNBOExportDescription.h"
 
 // visual studio warnings we're having trouble with
 #pragma warning(disable : 4800 4065 4668 4804 4018 4060 4554 4018)
@@ -15,7 +18,9 @@
 #include "MetasoundLog.h"
 
 #include "Internationalization/Text.h"
-#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <limits>
 
 #include "DecoderInputFactory.h"
 #include "DSP/BufferVectorOperations.h"
@@ -29,7 +34,6 @@
 
 #include "AudioDecompress.h"
 #include "Interfaces/IAudioFormat.h"
-#include "Tasks/Pipe.h"
 
 namespace RNBOMetasound {
 
@@ -47,25 +51,36 @@ struct WaveAssetDataRef
     RNBO::DataRefIndex Index;
     Metasound::FWaveAssetReadRef WaveAsset;
     FObjectKey WaveAssetProxyKey;
-    UE::Tasks::FTask Task;
-    TArray<UE::Tasks::FTask> Cleanup; // make sure not to leave running tasks dangling
+    float SampleRate; // of the graph, waves are resampled to it with au.RNBO.WaveBufferCache.ResampleToGraphRate
+    FDecodedWavePtr Default; // samples imported from the patch, bound until a wave is set on the pin
+    // load of the wave currently on the pin, carried out by FWaveBufferCache, which posts it back through the handoff
+    FWaveRequestPtr Request;
+    uint32 Generation = 0; // bumped whenever the load changes, waves posted for an older one are dropped
+    size_t BoundBytes = 0;  // size of the data currently bound to the core object
 
     WaveAssetDataRef(
         RNBO::CoreObject& coreObject,
         const char* id,
         const TCHAR* Name,
+        const TCHAR* ClassName, // of the node, for au.RNBO.WaveBufferCache.Stats
+        const FDecodedWavePtr& defaultWave,
         const Metasound::FOperatorSettings& InSettings,
         const Metasound::FDataReferenceCollection& InputCollection);
     ~WaveAssetDataRef();
     void Update();
+    void CancelLoad();
+    // audio thread, swap in a wave posted since the last block
+    void BindPending();
+    void BindDefault();
+    void Bind(FDecodedWavePtr Wave);
+    void Release();
+    // keeps the global and per operator counts in FWaveBufferCache up to date
+    void SetBoundBytes(size_t Bytes);
+
+    // map the samples RNBOMetasound.Build.cs imported for a buffer~ @file
+    static FDecodedWavePtr MapImported(const TCHAR* File);
 };
 
-bool IsBoolParam(const RNBO::Json& p);
-bool IsIntParam(const RNBO::Json& p);
-bool IsFloatParam(const RNBO::Json& p);
-bool IsInputParam(const RNBO::Json& p);
-bool IsOutputParam(const RNBO::Json& p);
-
 class FRNBOMetasoundParam
 {
   public:
@@ -93,16 +108,10 @@ class FRNBOMetasoundParam
     const FText DisplayName() const { return mDisplayName; }
     float InitialValue() const { return mInitialValue; }
 
-    static std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> InportTrig(const RNBO::Json& desc);
-    static std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> OutportTrig(const RNBO::Json& desc);
-    static std::vector<FRNBOMetasoundParam> InputAudio(const RNBO::Json& desc);
-    static std::vector<FRNBOMetasoundParam> OutputAudio(const RNBO::Json& desc);
-    static std::vector<FRNBOMetasoundParam> DataRef(const RNBO::Json& desc);
-    static bool MIDIIn(const RNBO::Json& desc);
-    static bool MIDIOut(const RNBO::Json& desc);
-    static std::vector<FRNBOMetasoundParam> Signals(const RNBO::Json& desc, std::string selector);
-    static void NumericParams(const RNBO::Json& desc, std::function<void(const RNBO::Json& param, RNBO::ParameterIndex index, const std::string& name, const std::string& displayName, const std::string& id)> func);
-    static std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam> NumericParamsFiltered(const RNBO::Json& desc, std::function<bool(const RNBO::Json& p)> filter);
+    static FRNBOMetasoundParam FromParam(const FRNBOExportParam& p);
+    static FRNBOMetasoundParam FromSignal(const FRNBOExportSignal& p);
+    static FRNBOMetasoundParam FromPort(const FRNBOExportPort& p);
+    static FRNBOMetasoundParam FromDataRef(const FRNBOExportDataRef& p);
 
     const FString mName;
     float mInitialValue;
@@ -114,33 +123,67 @@ class FRNBOMetasoundParam
 #define LOCTEXT_NAMESPACE "FRNBOOperator"
 
 // https://en.cppreference.com/w/cpp/language/template_parameters
-template <const RNBO::Json& desc, RNBO::PatcherFactoryFunctionPtr (*FactoryFunction)(RNBO::PlatformInterface* platformInterface)>
-class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc, FactoryFunction>>
+// Desc is the description struct generated for the export, see RNBOExportDescription.h
+template <class Desc, RNBO::PatcherFactoryFunctionPtr (*FactoryFunction)(RNBO::PlatformInterface* platformInterface)>
+class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<Desc, FactoryFunction>>
     , public RNBO::EventHandler
 {
   private:
-    RNBO::CoreObject CoreObject;
+    // typed param tables, in parameter index order, the slots of the members below match these
+    static constexpr auto InputFloatDesc = FilterParams<Desc, true, ERNBOParamType::Float>();
+    static constexpr auto InputIntDesc = FilterParams<Desc, true, ERNBOParamType::Int>();
+    static constexpr auto InputBoolDesc = FilterParams<Desc, true, ERNBOParamType::Bool>();
+    static constexpr auto OutputFloatDesc = FilterParams<Desc, false, ERNBOParamType::Float>();
+    static constexpr auto OutputIntDesc = FilterParams<Desc, false, ERNBOParamType::Int>();
+    static constexpr auto OutputBoolDesc = FilterParams<Desc, false, ERNBOParamType::Bool>();
+
+    static constexpr size_t NumInputFloat = InputFloatDesc.size();
+    static constexpr size_t NumInputInt = InputIntDesc.size();
+    static constexpr size_t NumInputBool = InputBoolDesc.size();
+    static constexpr size_t NumOutputFloat = OutputFloatDesc.size();
+    static constexpr size_t NumOutputInt = OutputIntDesc.size();
+    static constexpr size_t NumOutputBool = OutputBoolDesc.size();
+    static constexpr size_t NumInputParams = NumInputFloat + NumInputInt + NumInputBool;
+
+    static constexpr size_t NumInports = Desc::Inports.size();
+    static constexpr size_t NumOutports = Desc::Outports.size();
+    static constexpr size_t NumDataRefs = Desc::DataRefs.size();
+    static constexpr size_t NumInputAudio = Desc::InputSignals.size();
+    static constexpr size_t NumOutputAudio = Desc::OutputSignals.size();
+
+    // parameter indices of float, then int, then bool input params, matches mInputParamValues
+    static constexpr auto InputParamIndices = ParamIndices(InputFloatDesc, InputIntDesc, InputBoolDesc);
+    // indexed by parameter index
+    static constexpr auto InputParamSlots = ParamSlots<Desc::ParamCount>(InputFloatDesc, InputIntDesc, InputBoolDesc);
+    static constexpr auto OutputParamSlots = ParamSlots<Desc::ParamCount>(OutputFloatDesc, OutputIntDesc, OutputBoolDesc);
+
+    FCoreObjectPtr CoreObjectPtr;
+    RNBO::CoreObject& CoreObject;
     RNBO::TimeConverter Converter = RNBO::TimeConverter(44100.0, 0.0);
     RNBO::ParameterEventInterfaceUniquePtr ParamInterface;
 
     int32 mNumFrames;
     float mSampleRate;
 
-    std::unordered_map<RNBO::ParameterIndex, Metasound::FFloatReadRef> mInputFloatParams;
-    std::unordered_map<RNBO::ParameterIndex, Metasound::FInt32ReadRef> mInputIntParams;
-    std::unordered_map<RNBO::ParameterIndex, Metasound::FBoolReadRef> mInputBoolParams;
-    std::unordered_map<RNBO::MessageTag, Metasound::FTriggerReadRef> mInportTriggerParams;
-    std::vector<WaveAssetDataRef> mDataRefParams;
-
-    std::vector<Metasound::FAudioBufferReadRef> mInputAudioParams;
-    std::vector<const float*> mInputAudioBuffers;
-
-    std::unordered_map<RNBO::ParameterIndex, Metasound::FFloatWriteRef> mOutputFloatParams;
-    std::unordered_map<RNBO::ParameterIndex, Metasound::FInt32WriteRef> mOutputIntParams;
-    std::unordered_map<RNBO::ParameterIndex, Metasound::FBoolWriteRef> mOutputBoolParams;
-    std::unordered_map<RNBO::MessageTag, Metasound::FTriggerWriteRef> mOutportTriggerParams;
-    std::vector<Metasound::FAudioBufferWriteRef> mOutputAudioParams;
-    std::vector<float*> mOutputAudioBuffers;
+    std::array<Metasound::FFloatReadRef, NumInputFloat> mInputFloatParams;
+    std::array<Metasound::FInt32ReadRef, NumInputInt> mInputIntParams;
+    std::array<Metasound::FBoolReadRef, NumInputBool> mInputBoolParams;
+    // current and last sent values of the input params, float then int then bool slots, see InputParamIndices
+    std::array<double, NumInputParams> mInputParamValues = {};
+    std::array<double, NumInputParams> mInputParamShadow = {};
+    std::array<Metasound::FTriggerReadRef, NumInports> mInportTriggerParams;
+    std::array<WaveAssetDataRef, NumDataRefs> mDataRefParams;
+
+    std::array<Metasound::FAudioBufferReadRef, NumInputAudio> mInputAudioParams;
+    std::array<const float*, Desc::NumInputChannels> mInputAudioBuffers; // indexed by input channel
+    std::vector<float> mInputAudioSilence;                                // for channels without a pin
+
+    std::array<Metasound::FFloatWriteRef, NumOutputFloat> mOutputFloatParams;
+    std::array<Metasound::FInt32WriteRef, NumOutputInt> mOutputIntParams;
+    std::array<Metasound::FBoolWriteRef, NumOutputBool> mOutputBoolParams;
+    std::array<Metasound::FTriggerWriteRef, NumOutports> mOutportTriggerParams;
+    std::array<Metasound::FAudioBufferWriteRef, NumOutputAudio> mOutputAudioParams;
+    std::array<float*, Desc::NumOutputChannels> mOutputAudioBuffers = {};
 
     TOptional<FTransportReadRef> Transport;
 
@@ -153,116 +196,121 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
     int32 LastTransportNum = 0;
     int32 LastTransportDen = 0;
 
-    static const size_t ParamCount()
+    static FCoreObjectPool& Pool()
     {
-        static const size_t count = desc["parameters"].size();
-        return count;
+        static TSharedRef<FCoreObjectPool, ESPMode::ThreadSafe> pool = MakeShared<FCoreObjectPool, ESPMode::ThreadSafe>(FactoryFunction);
+        return *pool;
     }
 
-    static const std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam>& InputFloatParams()
+    // pin names and metadata, FText/FString can't be built at compile time
+    template <size_t N>
+    static std::array<FRNBOMetasoundParam, N> ParamsFrom(const std::array<FRNBOExportParam, N>& params)
     {
-        static const auto Params = FRNBOMetasoundParam::NumericParamsFiltered(desc, [](const RNBO::Json& p) -> bool { return IsInputParam(p) && IsFloatParam(p); });
-        return Params;
+        return MakeArray<FRNBOMetasoundParam, N>([&params](size_t i) { return FRNBOMetasoundParam::FromParam(params[i]); });
     }
 
-    static const std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam>& InputIntParams()
+    static const std::array<FRNBOMetasoundParam, NumInputFloat>& InputFloatParams()
     {
-        static const auto Params = FRNBOMetasoundParam::NumericParamsFiltered(desc, [](const RNBO::Json& p) -> bool { return IsInputParam(p) && IsIntParam(p); });
+        static const auto Params = ParamsFrom(InputFloatDesc);
         return Params;
     }
 
-    static const std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam>& InputBoolParams()
+    static const std::array<FRNBOMetasoundParam, NumInputInt>& InputIntParams()
     {
-        static const auto Params = FRNBOMetasoundParam::NumericParamsFiltered(desc, [](const RNBO::Json& p) -> bool { return IsInputParam(p) && IsBoolParam(p); });
+        static const auto Params = ParamsFrom(InputIntDesc);
         return Params;
     }
 
-    static const std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam>& OutputFloatParams()
+    static const std::array<FRNBOMetasoundParam, NumInputBool>& InputBoolParams()
     {
-        static const auto Params = FRNBOMetasoundParam::NumericParamsFiltered(desc, [](const RNBO::Json& p) -> bool { return IsOutputParam(p) && IsFloatParam(p); });
+        static const auto Params = ParamsFrom(InputBoolDesc);
         return Params;
     }
 
-    static const std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam>& OutputIntParams()
+    static const std::array<FRNBOMetasoundParam, NumOutputFloat>& OutputFloatParams()
     {
-        static const auto Params = FRNBOMetasoundParam::NumericParamsFiltered(desc, [](const RNBO::Json& p) -> bool { return IsOutputParam(p) && IsIntParam(p); });
+        static const auto Params = ParamsFrom(OutputFloatDesc);
         return Params;
     }
 
-    static const std::unordered_map<RNBO::ParameterIndex, FRNBOMetasoundParam>& OutputBoolParams()
+    static const std::array<FRNBOMetasoundParam, NumOutputInt>& OutputIntParams()
     {
-        static const auto Params = FRNBOMetasoundParam::NumericParamsFiltered(desc, [](const RNBO::Json& p) -> bool { return IsOutputParam(p) && IsBoolParam(p); });
+        static const auto Params = ParamsFrom(OutputIntDesc);
         return Params;
     }
 
-    static const std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam>& InportTrig()
+    static const std::array<FRNBOMetasoundParam, NumOutputBool>& OutputBoolParams()
     {
-        static const std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> Params = FRNBOMetasoundParam::InportTrig(desc);
+        static const auto Params = ParamsFrom(OutputBoolDesc);
         return Params;
     }
 
-    static const std::vector<FRNBOMetasoundParam>& DataRefParams()
+    static const std::array<FRNBOMetasoundParam, NumInports>& InportTrig()
     {
-        static const std::vector<FRNBOMetasoundParam> Params = FRNBOMetasoundParam::DataRef(desc);
+        static const auto Params = MakeArray<FRNBOMetasoundParam, NumInports>([](size_t i) { return FRNBOMetasoundParam::FromPort(Desc::Inports[i]); });
         return Params;
     }
 
-    static const std::vector<FRNBOMetasoundParam>& InputAudioParams()
+    static const std::array<RNBO::MessageTag, NumInports>& InportTags()
     {
-        static const std::vector<FRNBOMetasoundParam> Params = FRNBOMetasoundParam::InputAudio(desc);
-        return Params;
+        static const auto Tags = MakeArray<RNBO::MessageTag, NumInports>([](size_t i) { return RNBO::TAG(Desc::Inports[i].Tag); });
+        return Tags;
     }
 
-    static const std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam>& OutportTrig()
+    static const std::array<FRNBOMetasoundParam, NumDataRefs>& DataRefParams()
     {
-        static const std::unordered_map<RNBO::MessageTag, FRNBOMetasoundParam> Params = FRNBOMetasoundParam::OutportTrig(desc);
+        static const auto Params = MakeArray<FRNBOMetasoundParam, NumDataRefs>([](size_t i) { return FRNBOMetasoundParam::FromDataRef(Desc::DataRefs[i]); });
         return Params;
     }
 
-    static const std::vector<FRNBOMetasoundParam>& OutputAudioParams()
+    // mapped once, every instance maps its own copy of it unless au.RNBO.WaveBufferCache.ShareBoundData is set
+    static const std::array<FDecodedWavePtr, NumDataRefs>& DefaultBuffers()
+    {
+        static const auto Buffers = MakeArray<FDecodedWavePtr, NumDataRefs>([](size_t i) { return WaveAssetDataRef::MapImported(Desc::DataRefs[i].File); });
+        return Buffers;
+    }
+
+    static const std::array<FRNBOMetasoundParam, NumInputAudio>& InputAudioParams()
     {
-        static const std::vector<FRNBOMetasoundParam> Params = FRNBOMetasoundParam::OutputAudio(desc);
+        static const auto Params = MakeArray<FRNBOMetasoundParam, NumInputAudio>([](size_t i) { return FRNBOMetasoundParam::FromSignal(Desc::InputSignals[i]); });
         return Params;
     }
 
-    static const bool WithTransport()
+    static const std::array<FRNBOMetasoundParam, NumOutports>& OutportTrig()
     {
-        const std::string key = "transportUsed";
-        return !desc.contains(key) || desc[key].get<bool>();
+        static const auto Params = MakeArray<FRNBOMetasoundParam, NumOutports>([](size_t i) { return FRNBOMetasoundParam::FromPort(Desc::Outports[i]); });
+        return Params;
     }
 
-    static const bool WithMIDIIn()
+    // (tag, slot) sorted by tag
+    static const std::array<std::pair<RNBO::MessageTag, size_t>, NumOutports>& OutportTrigSlots()
     {
-        static const bool v = FRNBOMetasoundParam::FRNBOMetasoundParam::MIDIIn(desc);
-        return v;
+        auto Init = []() {
+            auto slots = MakeArray<std::pair<RNBO::MessageTag, size_t>, NumOutports>([](size_t i) { return std::make_pair(RNBO::TAG(Desc::Outports[i].Tag), i); });
+            std::sort(slots.begin(), slots.end());
+            return slots;
+        };
+        static const auto Slots = Init();
+        return Slots;
     }
 
-    static const bool WithMIDIOut()
+    static const std::array<FRNBOMetasoundParam, NumOutputAudio>& OutputAudioParams()
     {
-        static const bool v = FRNBOMetasoundParam::FRNBOMetasoundParam::MIDIOut(desc);
-        return v;
+        static const auto Params = MakeArray<FRNBOMetasoundParam, NumOutputAudio>([](size_t i) { return FRNBOMetasoundParam::FromSignal(Desc::OutputSignals[i]); });
+        return Params;
     }
 
   public:
     static const Metasound::FNodeClassMetadata& GetNodeInfo()
     {
         auto InitNodeInfo = []() -> Metasound::FNodeClassMetadata {
-            auto meta = desc["meta"];
-            std::string classname = meta["rnboobjname"];
-            std::string name;
             std::string description = "RNBO Generated";
             std::string category = "RNBO";
 
-            if (meta.contains("name")) {
-                name = meta["name"];
-            }
-            if (name.size() == 0 || name.compare("untitled") == 0) {
-                name = classname;
-            }
             // TODO description and category from meta?
 
-            FName ClassName(FString(classname.c_str()));
-            FText DisplayName = FText::AsCultureInvariant(name.c_str());
+            FName ClassName(Desc::ClassName);
+            FText DisplayName = FText::AsCultureInvariant(FString(Desc::DisplayName));
             FText Description = FText::AsCultureInvariant(description.c_str());
             FText Category = FText::AsCultureInvariant(category.c_str());
 
@@ -306,41 +354,35 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
                 inputs.Add(TInputDataVertex<Metasound::FAudioBuffer>(p.Name(), p.MetaData()));
             }
 
-            if (WithMIDIIn()) {
+            if (Desc::bMIDIIn) {
                 inputs.Add(TInputDataVertex<FMIDIBuffer>(METASOUND_GET_PARAM_NAME_AND_METADATA(ParamMIDIIn)));
             }
 
-            for (auto& it : InportTrig()) {
-                auto& p = it.second;
+            for (auto& p : InportTrig()) {
                 inputs.Add(TInputDataVertex<Metasound::FTrigger>(p.Name(), p.MetaData()));
             }
 
             // add params in order
-            {
-                auto& lookupFloat = InputFloatParams();
-                auto& lookupInt = InputIntParams();
-                auto& lookupBool = InputBoolParams();
-                auto count = ParamCount();
-                for (auto i = 0; i < count; i++) {
-                    auto it = lookupFloat.find(i);
-                    if (it != lookupFloat.end()) {
-                        auto& p = it->second;
+            for (auto& slot : InputParamSlots) {
+                switch (slot.Type) {
+                    case ERNBOParamType::Float:
+                    {
+                        auto& p = InputFloatParams()[slot.Slot];
                         inputs.Add(TInputDataVertex<float>(p.Name(), p.MetaData(), p.InitialValue()));
-                        continue;
-                    }
-                    it = lookupInt.find(i);
-                    if (it != lookupInt.end()) {
-                        auto& p = it->second;
+                    } break;
+                    case ERNBOParamType::Int:
+                    {
+                        auto& p = InputIntParams()[slot.Slot];
                         inputs.Add(TInputDataVertex<int32>(p.Name(), p.MetaData(), p.InitialValue()));
-                        continue;
-                    }
-                    it = lookupBool.find(i);
-                    if (it != lookupBool.end()) {
-                        auto& p = it->second;
+                    } break;
+                    case ERNBOParamType::Bool:
+                    {
+                        auto& p = InputBoolParams()[slot.Slot];
                         inputs.Add(TInputDataVertex<bool>(p.Name(), p.MetaData(), p.InitialValue() != 0.0f));
-                        continue;
-                    }
-                    // this is okay, we might have non mapped params
+                    } break;
+                    default:
+                        // this is okay, we might have non mapped params
+                        break;
                 }
             }
 
@@ -348,7 +390,7 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
                 inputs.Add(TInputDataVertex<Metasound::FWaveAsset>(p.Name(), p.MetaData()));
             }
 
-            if (WithTransport()) {
+            if (Desc::bTransport) {
                 inputs.Add(TInputDataVertex<FTransport>(METASOUND_GET_PARAM_NAME_AND_METADATA(ParamTransport)));
             }
 
@@ -358,41 +400,35 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
                 outputs.Add(TOutputDataVertex<Metasound::FAudioBuffer>(p.Name(), p.MetaData()));
             }
 
-            if (WithMIDIOut()) {
+            if (Desc::bMIDIOut) {
                 outputs.Add(TOutputDataVertex<FMIDIBuffer>(METASOUND_GET_PARAM_NAME_AND_METADATA(ParamMIDIOut)));
             }
 
-            for (auto& it : OutportTrig()) {
-                auto& p = it.second;
+            for (auto& p : OutportTrig()) {
                 outputs.Add(TOutputDataVertex<Metasound::FTrigger>(p.Name(), p.MetaData()));
             }
 
             // add params in order
-            {
-                auto& lookupFloat = OutputFloatParams();
-                auto& lookupInt = OutputIntParams();
-                auto& lookupBool = OutputBoolParams();
-                auto count = ParamCount();
-                for (auto i = 0; i < count; i++) {
-                    auto it = lookupFloat.find(i);
-                    if (it != lookupFloat.end()) {
-                        auto& p = it->second;
+            for (auto& slot : OutputParamSlots) {
+                switch (slot.Type) {
+                    case ERNBOParamType::Float:
+                    {
+                        auto& p = OutputFloatParams()[slot.Slot];
                         outputs.Add(TOutputDataVertex<float>(p.Name(), p.MetaData()));
-                        continue;
-                    }
-                    it = lookupInt.find(i);
-                    if (it != lookupInt.end()) {
-                        auto& p = it->second;
+                    } break;
+                    case ERNBOParamType::Int:
+                    {
+                        auto& p = OutputIntParams()[slot.Slot];
                         outputs.Add(TOutputDataVertex<int32>(p.Name(), p.MetaData()));
-                        continue;
-                    }
-                    it = lookupBool.find(i);
-                    if (it != lookupBool.end()) {
-                        auto& p = it->second;
+                    } break;
+                    case ERNBOParamType::Bool:
+                    {
+                        auto& p = OutputBoolParams()[slot.Slot];
                         outputs.Add(TOutputDataVertex<bool>(p.Name(), p.MetaData()));
-                        continue;
-                    }
-                    // this is okay, we might have non mapped params
+                    } break;
+                    default:
+                        // this is okay, we might have non mapped params
+                        break;
                 }
             }
 
@@ -418,91 +454,83 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
         const Metasound::FDataReferenceCollection& InputCollection,
         const Metasound::FInputVertexInterface& InputInterface,
         Metasound::FBuildErrorArray& OutErrors)
-        : CoreObject(RNBO::UniquePtr<RNBO::PatcherInterface>(FactoryFunction(RNBO::Platform::get())()))
+        : CoreObjectPtr(Pool().Acquire(InSettings.GetSampleRate(), InSettings.GetNumFramesPerBlock()))
+        , CoreObject(*CoreObjectPtr)
         , mNumFrames(InSettings.GetNumFramesPerBlock())
         , mSampleRate(InSettings.GetSampleRate())
-
+        // INPUTS
+        , mInputFloatParams(MakeArray<Metasound::FFloatReadRef, NumInputFloat>([&](size_t i) {
+            return InputCollection.GetDataReadReferenceOrConstructWithVertexDefault<float>(InputInterface, InputFloatParams()[i].Name(), InSettings);
+        }))
+        , mInputIntParams(MakeArray<Metasound::FInt32ReadRef, NumInputInt>([&](size_t i) {
+            return InputCollection.GetDataReadReferenceOrConstructWithVertexDefault<int32>(InputInterface, InputIntParams()[i].Name(), InSettings);
+        }))
+        , mInputBoolParams(MakeArray<Metasound::FBoolReadRef, NumInputBool>([&](size_t i) {
+            return InputCollection.GetDataReadReferenceOrConstructWithVertexDefault<bool>(InputInterface, InputBoolParams()[i].Name(), InSettings);
+        }))
+        , mInportTriggerParams(MakeArray<Metasound::FTriggerReadRef, NumInports>([&](size_t i) {
+            return InputCollection.GetDataReadReferenceOrConstruct<Metasound::FTrigger>(InportTrig()[i].Name(), InSettings);
+        }))
+        , mDataRefParams(MakeArray<WaveAssetDataRef, NumDataRefs>([&](size_t i) {
+            auto id = CoreObject.getExternalDataId(static_cast<RNBO::DataRefIndex>(Desc::DataRefs[i].Index));
+            return WaveAssetDataRef(CoreObject, id, DataRefParams()[i].Name(), Desc::ClassName, DefaultBuffers()[i], InSettings, InputCollection);
+        }))
+        , mInputAudioParams(MakeArray<Metasound::FAudioBufferReadRef, NumInputAudio>([&](size_t i) {
+            return InputCollection.GetDataReadReferenceOrConstruct<Metasound::FAudioBuffer>(InputAudioParams()[i].Name(), InSettings);
+        }))
+        , mInputAudioSilence(InSettings.GetNumFramesPerBlock(), 0.0f)
+        // OUTPUTS
+        , mOutputFloatParams(MakeArray<Metasound::FFloatWriteRef, NumOutputFloat>([](size_t i) {
+            return Metasound::FFloatWriteRef::CreateNew(OutputFloatDesc[i].InitialValue);
+        }))
+        , mOutputIntParams(MakeArray<Metasound::FInt32WriteRef, NumOutputInt>([](size_t i) {
+            return Metasound::FInt32WriteRef::CreateNew(static_cast<int32>(OutputIntDesc[i].InitialValue));
+        }))
+        , mOutputBoolParams(MakeArray<Metasound::FBoolWriteRef, NumOutputBool>([](size_t i) {
+            return Metasound::FBoolWriteRef::CreateNew(OutputBoolDesc[i].InitialValue != 0.0f);
+        }))
+        , mOutportTriggerParams(MakeArray<Metasound::FTriggerWriteRef, NumOutports>([&](size_t) {
+            return Metasound::FTriggerWriteRef::CreateNew(InSettings);
+        }))
+        , mOutputAudioParams(MakeArray<Metasound::FAudioBufferWriteRef, NumOutputAudio>([&](size_t) {
+            return Metasound::FAudioBufferWriteRef::CreateNew(InSettings);
+        }))
     {
-        CoreObject.prepareToProcess(InSettings.GetSampleRate(), InSettings.GetNumFramesPerBlock());
         // all params are handled in the audio thread, single producer seems to have better performance than NotThreadSafe
         ParamInterface = CoreObject.createParameterInterface(RNBO::ParameterEventInterface::SingleProducer, this);
 
-        // INPUTS
-        for (auto& it : InportTrig()) {
-            mInportTriggerParams.emplace(it.first, InputCollection.GetDataReadReferenceOrConstruct<Metasound::FTrigger>(it.second.Name(), InSettings));
-        }
-
-        if (WithMIDIIn()) {
-            MIDIIn = { InputCollection.GetDataReadReferenceOrConstruct<FMIDIBuffer>(METASOUND_GET_PARAM_NAME(ParamMIDIIn), InSettings) };
-        }
-
-        for (auto& it : InputFloatParams()) {
-            mInputFloatParams.emplace(it.first, InputCollection.GetDataReadReferenceOrConstructWithVertexDefault<float>(InputInterface, it.second.Name(), InSettings));
-        }
-
-        for (auto& it : InputIntParams()) {
-            mInputIntParams.emplace(it.first, InputCollection.GetDataReadReferenceOrConstructWithVertexDefault<int32>(InputInterface, it.second.Name(), InSettings));
-        }
+        ResetInputParamShadow();
 
-        for (auto& it : InputBoolParams()) {
-            mInputBoolParams.emplace(it.first, InputCollection.GetDataReadReferenceOrConstructWithVertexDefault<bool>(InputInterface, it.second.Name(), InSettings));
-        }
+        // channels without a pin read silence
+        mInputAudioBuffers.fill(mInputAudioSilence.data());
 
-        {
-            RNBO::DataRefIndex index = 0;
-            for (auto& p : DataRefParams()) {
-                auto id = CoreObject.getExternalDataId(index++);
-                mDataRefParams.emplace_back(CoreObject, id, p.Name(), InSettings, InputCollection);
-            }
+        for (auto& p : mDataRefParams) {
+            p.BindDefault();
         }
 
-        for (auto& p : InputAudioParams()) {
-            mInputAudioParams.emplace_back(InputCollection.GetDataReadReferenceOrConstruct<Metasound::FAudioBuffer>(p.Name(), InSettings));
-            mInputAudioBuffers.emplace_back(nullptr);
+        if constexpr (Desc::bMIDIIn) {
+            MIDIIn = { InputCollection.GetDataReadReferenceOrConstruct<FMIDIBuffer>(METASOUND_GET_PARAM_NAME(ParamMIDIIn), InSettings) };
         }
-
-        // OUTPUTS
-
-        for (auto& it : OutportTrig()) {
-            mOutportTriggerParams.emplace(it.first, Metasound::FTriggerWriteRef::CreateNew(InSettings));
+        if constexpr (Desc::bTransport) {
+            Transport = { InputCollection.GetDataReadReferenceOrConstruct<FTransport>(METASOUND_GET_PARAM_NAME(ParamTransport)) };
         }
-
-        if (WithMIDIOut()) {
+        if constexpr (Desc::bMIDIOut) {
             MIDIOut = FMIDIBufferWriteRef::CreateNew(InSettings);
         }
+    }
 
-        for (auto& it : OutputFloatParams()) {
-            mOutputFloatParams.emplace(it.first, Metasound::FFloatWriteRef::CreateNew(it.second.InitialValue()));
-        }
-
-        for (auto& it : OutputIntParams()) {
-            mOutputIntParams.emplace(it.first, Metasound::FInt32WriteRef::CreateNew(static_cast<int32>(it.second.InitialValue())));
-        }
-
-        for (auto& it : OutputBoolParams()) {
-            mOutputBoolParams.emplace(it.first, Metasound::FBoolWriteRef::CreateNew(it.second.InitialValue() != 0.0f));
-        }
-
-        for (auto& p : OutputAudioParams()) {
-            mOutputAudioParams.emplace_back(Metasound::FAudioBufferWriteRef::CreateNew(InSettings));
-            mOutputAudioBuffers.emplace_back(nullptr);
-        }
-
-        if (WithTransport()) {
-            Transport = { InputCollection.GetDataReadReferenceOrConstruct<FTransport>(METASOUND_GET_PARAM_NAME(ParamTransport)) };
-        }
+    virtual ~FRNBOOperator()
+    {
+        // no more events from the core object, binds still in flight don't touch it
+        ParamInterface.reset();
     }
 
     virtual void BindInputs(Metasound::FInputVertexInterfaceData& InOutVertexData) override
     {
         {
-            auto lookup = InportTrig();
-            for (auto& [index, p] : mInportTriggerParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = InportTrig();
+            for (size_t i = 0; i < mInportTriggerParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mInportTriggerParams[i]);
             }
         }
 
@@ -511,37 +539,25 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
         }
 
         {
-            auto lookup = InputFloatParams();
-            for (auto& [index, p] : mInputFloatParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = InputFloatParams();
+            for (size_t i = 0; i < mInputFloatParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mInputFloatParams[i]);
             }
         }
         {
-            auto lookup = InputIntParams();
-            for (auto& [index, p] : mInputIntParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = InputIntParams();
+            for (size_t i = 0; i < mInputIntParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mInputIntParams[i]);
             }
         }
         {
-            auto lookup = InputBoolParams();
-            for (auto& [index, p] : mInputBoolParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = InputBoolParams();
+            for (size_t i = 0; i < mInputBoolParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mInputBoolParams[i]);
             }
         }
         {
-            auto lookup = DataRefParams();
+            auto& lookup = DataRefParams();
             for (size_t i = 0; i < mDataRefParams.size(); i++) {
                 auto& p = lookup[i];
                 InOutVertexData.BindReadVertex(p.Name(), mDataRefParams[i].WaveAsset);
@@ -551,7 +567,7 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
             InOutVertexData.BindReadVertex(METASOUND_GET_PARAM_NAME(ParamTransport), Transport.GetValue());
         }
         {
-            auto lookup = InputAudioParams();
+            auto& lookup = InputAudioParams();
             for (size_t i = 0; i < mInputAudioParams.size(); i++) {
                 auto& p = lookup[i];
                 InOutVertexData.BindReadVertex(p.Name(), mInputAudioParams[i]);
@@ -562,13 +578,9 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
     virtual void BindOutputs(Metasound::FOutputVertexInterfaceData& InOutVertexData) override
     {
         {
-            auto lookup = OutportTrig();
-            for (auto& [index, p] : mOutportTriggerParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = OutportTrig();
+            for (size_t i = 0; i < mOutportTriggerParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mOutportTriggerParams[i]);
             }
         }
 
@@ -577,38 +589,26 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
         }
 
         {
-            auto lookup = OutputFloatParams();
-            for (auto& [index, p] : mOutputFloatParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = OutputFloatParams();
+            for (size_t i = 0; i < mOutputFloatParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mOutputFloatParams[i]);
             }
         }
         {
-            auto lookup = OutputIntParams();
-            for (auto& [index, p] : mOutputIntParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = OutputIntParams();
+            for (size_t i = 0; i < mOutputIntParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mOutputIntParams[i]);
             }
         }
         {
-            auto lookup = OutputBoolParams();
-            for (auto& [index, p] : mOutputBoolParams) {
-                auto it = lookup.find(index);
-                // should never fail
-                if (it != lookup.end()) {
-                    InOutVertexData.BindReadVertex(it->second.Name(), p);
-                }
+            auto& lookup = OutputBoolParams();
+            for (size_t i = 0; i < mOutputBoolParams.size(); i++) {
+                InOutVertexData.BindReadVertex(lookup[i].Name(), mOutputBoolParams[i]);
             }
         }
 
         {
-            auto lookup = OutputAudioParams();
+            auto& lookup = OutputAudioParams();
             for (size_t i = 0; i < mOutputAudioParams.size(); i++) {
                 auto& p = lookup[i];
                 InOutVertexData.BindReadVertex(p.Name(), mOutputAudioParams[i]);
@@ -620,37 +620,42 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
     {
         Converter = { CoreObject.getSampleRate(), CoreObject.getCurrentTime() };
 
-        if (MIDIOut.IsSet()) {
+        if constexpr (Desc::bMIDIOut) {
             MIDIOut.GetValue()->AdvanceBlock();
         }
 
         // update outport triggers
-        for (auto it : mOutportTriggerParams) {
-            it.second->AdvanceBlock();
+        for (auto& p : mOutportTriggerParams) {
+            p->AdvanceBlock();
         }
 
         // setup audio buffers
-        for (size_t i = 0; i < mInputAudioBuffers.size(); i++) {
-            mInputAudioBuffers[i] = mInputAudioParams[i]->GetData();
+        for (size_t i = 0; i < NumInputAudio; i++) {
+            mInputAudioBuffers[Desc::InputSignals[i].Channel] = mInputAudioParams[i]->GetData();
         }
 
-        for (size_t i = 0; i < mOutputAudioBuffers.size(); i++) {
-            mOutputAudioBuffers[i] = mOutputAudioParams[i]->GetData();
+        for (size_t i = 0; i < NumOutputAudio; i++) {
+            mOutputAudioBuffers[Desc::OutputSignals[i].Channel] = mOutputAudioParams[i]->GetData();
         }
 
-        if (MIDIIn.IsSet()) {
+        if constexpr (Desc::bMIDIIn) {
             auto& midiin = MIDIIn.GetValue();
             const int32 num = midiin->NumInBlock();
             for (int32 i = 0; i < num; i++) {
-                const auto& e = (*midiin)[i];
+                const auto e = (*midiin)[i];
                 auto ms = Converter.convertSampleOffsetToMilliseconds(static_cast<RNBO::SampleOffset>(e.Frame()));
 
-                RNBO::MidiEvent event(ms, 0, e.Data().data(), e.Length());
-                ParamInterface->scheduleEvent(event);
+                // a MidiEvent holds up to 3 bytes, longer messages (SysEx) go in pieces, which the patcher parses as
+                // one byte stream
+                const uint8_t* bytes = e.Bytes();
+                for (size_t o = 0; o < e.Length(); o += 3) {
+                    RNBO::MidiEvent event(ms, 0, bytes + o, std::min<size_t>(e.Length() - o, 3));
+                    ParamInterface->scheduleEvent(event);
+                }
             }
         }
 
-        if (Transport.IsSet()) {
+        if constexpr (Desc::bTransport) {
             auto& transport = Transport.GetValue();
             double btime = std::max(0.0, transport->GetBeatTime().GetSeconds()); // not actually seconds
             if (LastTransportBeatTime != btime)
@@ -690,46 +695,103 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
             }
         }
 
-        for (auto& [index, p] : mInputFloatParams) {
-            double v = static_cast<double>(*p);
-            if (v != ParamInterface->getParameterValue(index)) {
-                ParamInterface->setParameterValue(index, v);
-            }
-        }
-        for (auto& [index, p] : mInputIntParams) {
-            double v = static_cast<double>(*p);
-            if (v != ParamInterface->getParameterValue(index)) {
-                ParamInterface->setParameterValue(index, v);
-            }
-        }
-        for (auto& [index, p] : mInputBoolParams) {
-            double v = *p ? 1.0 : 0.0;
-            if (v != ParamInterface->getParameterValue(index)) {
-                ParamInterface->setParameterValue(index, v);
-            }
-        }
-        for (auto& [tag, p] : mInportTriggerParams) {
-            for (int32 i = 0; i < p->NumTriggeredInBlock(); i++) {
-                auto frame = (*p)[i];
-                ParamInterface->sendMessage(tag, 0, Converter.convertSampleOffsetToMilliseconds(static_cast<RNBO::SampleOffset>(frame)));
+        UpdateInputParams();
+        {
+            auto& tags = InportTags();
+            for (size_t i = 0; i < NumInports; i++) {
+                const auto tag = tags[i];
+                auto& p = mInportTriggerParams[i];
+                for (int32 j = 0; j < p->NumTriggeredInBlock(); j++) {
+                    auto frame = (*p)[j];
+                    ParamInterface->sendMessage(tag, 0, Converter.convertSampleOffsetToMilliseconds(static_cast<RNBO::SampleOffset>(frame)));
+                }
             }
         }
         for (auto& p : mDataRefParams) {
             p.Update();
+            p.BindPending();
         }
 
         CoreObject.process(static_cast<const float* const*>(mInputAudioBuffers.data()), mInputAudioBuffers.size(), mOutputAudioBuffers.data(), mOutputAudioBuffers.size(), mNumFrames);
     }
 
-    // does this ever get called?
+    // gather the input param values and forward only the ones that changed since we last sent them
+    void UpdateInputParams()
+    {
+        constexpr size_t count = NumInputParams;
+        if constexpr (count == 0) {
+            return;
+        }
+
+        double* values = mInputParamValues.data();
+        size_t o = 0;
+        for (auto& p : mInputFloatParams) {
+            values[o++] = static_cast<double>(*p);
+        }
+        for (auto& p : mInputIntParams) {
+            values[o++] = static_cast<double>(*p);
+        }
+        for (auto& p : mInputBoolParams) {
+            values[o++] = *p ? 1.0 : 0.0;
+        }
+
+        // the common case is that nothing changed, a single compare over the contiguous block covers it
+        double* shadow = mInputParamShadow.data();
+        if (FMemory::Memcmp(values, shadow, sizeof(double) * count) == 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (values[i] != shadow[i]) {
+                ParamInterface->setParameterValue(InputParamIndices[i], values[i]);
+            }
+            shadow[i] = values[i];
+        }
+    }
+
+    // invalidate the shadow so that every input param is sent on the next block
+    void ResetInputParamShadow()
+    {
+        std::fill(mInputParamShadow.begin(), mInputParamShadow.end(), std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // called when the graph is reused, put everything back to how a newly created operator would be
     void Reset(const Metasound::IOperator::FResetParams& InParams)
     {
-        for (auto it : mOutportTriggerParams) {
-            it.second->Reset();
+        // the block size and rate the operator was built with: the silence, audio and MIDI buffers are sized for them
+        // and the pool takes the core object back into the bucket it came from
+        Pool().ResetCoreObject(CoreObject, mSampleRate, mNumFrames);
+        ResetInputParamShadow();
+
+        for (auto& p : mDataRefParams) {
+            p.CancelLoad();
+            p.WaveAssetProxyKey = FObjectKey();
+            // released by ResetCoreObject
+            p.SetBoundBytes(0);
+            p.BindDefault();
+        }
+
+        for (auto& p : mOutportTriggerParams) {
+            p->Reset();
         }
         if (MIDIOut.IsSet()) {
             MIDIOut.GetValue()->Reset();
         }
+        for (size_t i = 0; i < NumOutputFloat; i++) {
+            (*mOutputFloatParams[i]) = OutputFloatDesc[i].InitialValue;
+        }
+        for (size_t i = 0; i < NumOutputInt; i++) {
+            (*mOutputIntParams[i]) = static_cast<int32>(OutputIntDesc[i].InitialValue);
+        }
+        for (size_t i = 0; i < NumOutputBool; i++) {
+            (*mOutputBoolParams[i]) = OutputBoolDesc[i].InitialValue != 0.0f;
+        }
+
+        LastTransportBeatTime = -1.0;
+        LastTransportBPM = 0.0f;
+        LastTransportRun = false;
+        LastTransportNum = 0;
+        LastTransportDen = 0;
     }
 
     virtual void eventsAvailable()
@@ -739,26 +801,24 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
 
     virtual void handleParameterEvent(const RNBO::ParameterEvent& event) override
     {
-        {
-            auto it = mOutputBoolParams.find(event.getIndex());
-            if (it != mOutputBoolParams.end()) {
-                (*it->second) = static_cast<bool>(event.getValue() != 0.0f);
-                return;
-            }
-        }
-        {
-            auto it = mOutputFloatParams.find(event.getIndex());
-            if (it != mOutputFloatParams.end()) {
-                (*it->second) = static_cast<float>(event.getValue());
-                return;
-            }
+        auto& lookup = OutputParamSlots;
+        const auto index = static_cast<size_t>(event.getIndex());
+        if (index >= lookup.size()) {
+            return;
         }
-        {
-            auto it = mOutputIntParams.find(event.getIndex());
-            if (it != mOutputIntParams.end()) {
-                (*it->second) = static_cast<int32>(event.getValue());
-                return;
-            }
+        const auto& slot = lookup[index];
+        switch (slot.Type) {
+            case ERNBOParamType::Bool:
+                (*mOutputBoolParams[slot.Slot]) = static_cast<bool>(event.getValue() != 0.0f);
+                break;
+            case ERNBOParamType::Float:
+                (*mOutputFloatParams[slot.Slot]) = static_cast<float>(event.getValue());
+                break;
+            case ERNBOParamType::Int:
+                (*mOutputIntParams[slot.Slot]) = static_cast<int32>(event.getValue());
+                break;
+            default:
+                break;
         }
     }
 
@@ -767,10 +827,12 @@ class FRNBOOperator : public Metasound::TExecutableOperator<FRNBOOperator<desc,
         switch (event.getType()) {
             case RNBO::MessageEvent::Type::Bang:
             {
-                auto it = mOutportTriggerParams.find(event.getTag());
-                if (it != mOutportTriggerParams.end()) {
+                auto& lookup = OutportTrigSlots();
+                const auto tag = event.getTag();
+                auto it = std::lower_bound(lookup.begin(), lookup.end(), tag, [](const std::pair<RNBO::MessageTag, size_t>& s, RNBO::MessageTag t) { return s.first < t; });
+                if (it != lookup.end() && it->first == tag) {
                     RNBO::SampleOffset frame = Converter.convertMillisecondsToSampleOffset(event.getTime());
-                    it->second->TriggerFrame(static_cast<int32>(frame));
+                    mOutportTriggerParams[it->second]->TriggerFrame(static_cast<int32>(frame));
                 }
             } break;
             default:
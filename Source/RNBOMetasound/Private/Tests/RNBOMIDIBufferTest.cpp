@@ -0,0 +1,646 @@
+#include "RNBOMIDI.h"
+
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#include <tuple>
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace {
+using RNBOMetasound::EMIDIOverflowPolicy;
+using RNBOMetasound::FMIDIBuffer;
+using RNBOMetasound::FMIDIPacket;
+
+// The linear scan PushNote FMIDIBuffer used before the note state table, kept as the reference its output is checked
+// against
+class FReferenceMIDIBuffer
+{
+  public:
+    FReferenceMIDIBuffer(const Metasound::FOperatorSettings& InSettings)
+        : NumFramesPerBlock(InSettings.GetNumFramesPerBlock())
+    {
+    }
+
+    void AdvanceBlock()
+    {
+        Packets.RemoveAt(0, CountInBlock, false);
+        CountInBlock = 0;
+        LastFrame = -1;
+        for (auto& packet : Packets) {
+            packet.Advance(NumFramesPerBlock);
+            if (packet.Frame() < NumFramesPerBlock) {
+                CountInBlock++;
+            }
+            LastFrame = packet.Frame();
+        }
+    }
+
+    int32 NumInBlock() const { return CountInBlock; }
+    FMIDIPacket operator[](int32 index) const { return Packets[index]; }
+
+    void Push(FMIDIPacket packet)
+    {
+        const auto frame = packet.Frame();
+        if (frame < NumFramesPerBlock) {
+            CountInBlock++;
+        }
+        if (frame >= LastFrame) {
+            LastFrame = frame;
+            Packets.Push(packet);
+            return;
+        }
+        for (int32 i = 0; i < Packets.Num(); i++) {
+            if (Packets[i].Frame() > frame) {
+                Packets.Insert(packet, i);
+                return;
+            }
+        }
+    }
+
+    void PushNote(int32 start, int32 dur, uint8_t chan, uint8_t note, uint8_t onvel, uint8_t offvel)
+    {
+        const auto end = start + dur;
+        for (int32 i = 0; i < Packets.Num(); i++) {
+            const auto& p = Packets[i];
+            const auto f = p.Frame();
+            if (f < start) {
+                continue;
+            }
+            if (p.IsNoteOn(chan, note)) {
+                if (f < end) {
+                    Packets.Insert(FMIDIPacket::NoteOff(f, note, offvel, chan), i);
+                    if (f < NumFramesPerBlock) {
+                        CountInBlock++;
+                    }
+                    Push(FMIDIPacket::NoteOn(start, note, onvel, chan));
+                    return;
+                }
+                break;
+            }
+            if (p.IsNoteOff(chan, note) && f > start) {
+                auto off = p.CloneTo(start);
+                Packets.RemoveAt(i);
+                if (f < NumFramesPerBlock) {
+                    CountInBlock--;
+                }
+                LastFrame = Packets.Num() > 0 ? Packets.Last().Frame() : -1;
+                Push(off);
+                break;
+            }
+        }
+        Push(FMIDIPacket::NoteOn(start, note, onvel, chan));
+        Push(FMIDIPacket::NoteOff(end, note, offvel, chan));
+    }
+
+  private:
+    int32 NumFramesPerBlock;
+    int32 CountInBlock = 0;
+    int32 LastFrame = -1;
+    TArray<FMIDIPacket> Packets;
+};
+
+using FPacketKey = std::tuple<int32, int32, uint8_t, uint8_t, uint8_t>;
+
+template <typename TBuffer>
+TArray<FPacketKey> BlockOf(const TBuffer& Buffer, bool bSorted)
+{
+    TArray<FPacketKey> keys;
+    for (int32 i = 0; i < Buffer.NumInBlock(); i++) {
+        const auto p = Buffer[i];
+        const auto& d = p.Data();
+        const int32 len = static_cast<int32>(p.Length());
+        keys.Emplace(p.Frame(), len, d[0], len > 1 ? d[1] : 0, len > 2 ? d[2] : 0);
+    }
+    if (bSorted) {
+        keys.Sort();
+    }
+    return keys;
+}
+
+Metasound::FOperatorSettings BlockSettings()
+{
+    return Metasound::FOperatorSettings(48000, 48000.0f / 256.0f);
+}
+
+FMIDIPacket Message(int32 frame, uint8_t status, uint8_t data1, uint8_t data2)
+{
+    const uint8_t data[3] = { status, data1, data2 };
+    // program change and channel pressure have a single data byte
+    const uint8_t kind = status & 0xF0;
+    return FMIDIPacket(frame, kind == 0xC0 || kind == 0xD0 ? 2 : 3, data);
+}
+
+// the bytes of a SysEx message, different for every length and seed
+TArray<uint8_t> LongMessage(int32 length, int32 seed)
+{
+    TArray<uint8_t> bytes;
+    bytes.SetNumUninitialized(length);
+    for (int32 i = 0; i < length; i++) {
+        bytes[i] = i == 0 ? 0xF0 : (i == length - 1 ? 0xF7 : static_cast<uint8_t>((i * 7 + seed) & 0x7F));
+    }
+    return bytes;
+}
+
+bool HasBytes(const FMIDIPacket& packet, const TArray<uint8_t>& bytes)
+{
+    return packet.Length() == static_cast<size_t>(bytes.Num()) && FMemory::Memcmp(packet.Bytes(), bytes.GetData(), bytes.Num()) == 0;
+}
+} // namespace
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferPushNoteTest, "RNBO.MIDIBuffer.PushNote", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferPushNoteTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+
+    // the first half only pushes notes, which come out in the same order. The second half mixes in packets pushed
+    // with Push, offs then come before packets at the same frame pushed after them, so blocks are compared sorted
+    for (int32 seed = 0; seed < 400; seed++) {
+        const bool bMixed = seed >= 200;
+        FRandomStream rng(seed);
+        FReferenceMIDIBuffer expected(settings);
+        FMIDIBuffer actual(settings, 0, 0, RNBOMetasound::EMIDIOverflowPolicy::DropNewest);
+
+        int32 last = 0;
+        for (int32 step = 0; step < 3000 + 30; step++) {
+            const int32 op = step < 3000 ? rng.RandRange(0, 9) : 0;
+            if (op < 3) {
+                expected.AdvanceBlock();
+                actual.AdvanceBlock();
+                last = 0;
+                if (BlockOf(expected, bMixed) != BlockOf(actual, bMixed)) {
+                    AddError(FString::Printf(TEXT("seed %d step %d: block differs from the reference"), seed, step));
+                    return false;
+                }
+            }
+            else if (op < 6 && bMixed) {
+                const int32 frame = rng.RandRange(0, 1999);
+                const uint8_t data[3] = { static_cast<uint8_t>(0xB0 | rng.RandRange(0, 15)), static_cast<uint8_t>(rng.RandRange(0, 127)), static_cast<uint8_t>(rng.RandRange(0, 127)) };
+                const size_t length = static_cast<size_t>(rng.RandRange(1, 3));
+                expected.Push(FMIDIPacket(frame, length, data));
+                actual.Push(FMIDIPacket(frame, length, data));
+            }
+            else {
+                // trigger frames come in order, some at the same frame
+                const int32 start = last + (rng.RandRange(0, 2) == 0 ? 0 : rng.RandRange(0, frames - 1 - last));
+                last = start;
+                const int32 dur = 1 + (seed % 2 ? rng.RandRange(0, 2999) : (rng.RandRange(0, 4) == 0 ? rng.RandRange(0, 299) : 1000));
+                // few channels and notes so they overlap
+                const uint8_t chan = static_cast<uint8_t>(rng.RandRange(0, 1));
+                const uint8_t note = static_cast<uint8_t>(rng.RandRange(0, 3));
+                expected.PushNote(start, dur, chan, note, 100, 0);
+                actual.PushNote(start, dur, chan, note, 100, 0);
+            }
+        }
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferPushNoteBenchmark, "RNBO.MIDIBuffer.PushNoteBenchmark", EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+
+bool FRNBOMIDIBufferPushNoteBenchmark::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+    constexpr int32 NumBlocks = 2000;
+
+    // dense polyphony: notes on every channel and number, 1 to 10 s long, so most of them overlap an earlier one
+    auto run = [&](auto& buffer, int32 notesPerBlock) {
+        FRandomStream rng(1);
+        const double begin = FPlatformTime::Seconds();
+        for (int32 block = 0; block < NumBlocks; block++) {
+            buffer.AdvanceBlock();
+            for (int32 i = 0; i < notesPerBlock; i++) {
+                buffer.PushNote(i * frames / notesPerBlock, rng.RandRange(48000, 480000), static_cast<uint8_t>(rng.RandRange(0, 15)), static_cast<uint8_t>(rng.RandRange(0, 127)), 100, 0);
+            }
+        }
+        return (FPlatformTime::Seconds() - begin) * 1e6 / NumBlocks;
+    };
+
+    for (int32 notesPerBlock : { 4, 16, 64 }) {
+        FReferenceMIDIBuffer reference(settings);
+        FMIDIBuffer buffer(settings, 0, 0, RNBOMetasound::EMIDIOverflowPolicy::DropNewest);
+        const double before = run(reference, notesPerBlock);
+        const double after = run(buffer, notesPerBlock);
+        AddInfo(FString::Printf(TEXT("%d notes/block: linear scan %.2f us/block, note table %.2f us/block"), notesPerBlock, before, after));
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferFixedCapacityTest, "RNBO.MIDIBuffer.FixedCapacity", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferFixedCapacityTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+    if (!TestTrue(TEXT("pins have a fixed capacity by default"), FMIDIBuffer::DefaultCapacity() > 0)) {
+        return false;
+    }
+
+    // the capacity pins are created with, the policy set so the outcome is known
+    const int32 capacity = static_cast<int32>(FMath::RoundUpToPowerOfTwo(static_cast<uint32>(FMIDIBuffer::DefaultCapacity())));
+    FMIDIBuffer buffer(settings, FMIDIBuffer::DefaultCapacity(), FMIDIBuffer::DefaultPayloadBytes(), EMIDIOverflowPolicy::DropNewest);
+
+    for (int32 pass = 0; pass < 2; pass++) {
+        const int32 total = capacity + 100;
+        for (int32 i = 0; i < total; i++) {
+            buffer.Push(Message(i * frames / total, 0xB0, static_cast<uint8_t>(i % 128), static_cast<uint8_t>(i / 128)));
+        }
+
+        TestEqual(TEXT("packets held"), buffer.NumInBlock(), capacity);
+        TestEqual(TEXT("packets dropped"), buffer.NumDropped(), 100 * (pass + 1));
+        TestEqual(TEXT("peak"), buffer.PeakNum(), capacity);
+
+        // the first ones pushed are kept, in order
+        for (int32 i = 0; i < buffer.NumInBlock(); i++) {
+            const auto p = buffer[i];
+            const auto& d = p.Data();
+            if (p.Frame() != i * frames / total || d[1] != i % 128 || d[2] != i / 128) {
+                AddError(FString::Printf(TEXT("pass %d: packet %d isn't the packet pushed %d"), pass, i, i));
+                return false;
+            }
+        }
+
+        // the next block starts empty and takes as many again
+        buffer.AdvanceBlock();
+        TestEqual(TEXT("packets after advancing"), buffer.NumInBlock(), 0);
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferDropOldestTest, "RNBO.MIDIBuffer.DropOldest", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferDropOldestTest::RunTest(const FString& Parameters)
+{
+    FMIDIBuffer buffer(BlockSettings(), 16, 0, EMIDIOverflowPolicy::DropOldest);
+
+    // 8 note packets, then twice as many controllers as there is room left for
+    for (int32 i = 0; i < 4; i++) {
+        buffer.PushNote(i * 10, 5, 0, static_cast<uint8_t>(i), 100, 0);
+    }
+    for (int32 i = 0; i < 16; i++) {
+        buffer.Push(Message(100 + i, 0xB0, 1, static_cast<uint8_t>(i)));
+    }
+    TestEqual(TEXT("dropped controllers"), buffer.NumDropped(), 8);
+
+    TArray<FPacketKey> expected;
+    for (int32 i = 0; i < 4; i++) {
+        expected.Emplace(i * 10, 3, 0x90, i, 100);
+        expected.Emplace(i * 10 + 5, 3, 0x80, i, 0);
+    }
+    for (int32 i = 8; i < 16; i++) {
+        expected.Emplace(100 + i, 3, 0xB0, 1, i);
+    }
+    if (!TestTrue(TEXT("notes kept, latest controllers kept"), BlockOf(buffer, false) == expected)) {
+        return false;
+    }
+
+    // notes make room by dropping controllers too, but never other notes
+    for (int32 i = 0; i < 5; i++) {
+        buffer.PushNote(130 + i * 10, 5, 1, static_cast<uint8_t>(i), 100, 0);
+    }
+    buffer.Push(Message(180, 0xB0, 1, 127));
+    TestEqual(TEXT("dropped controllers, then the note and controller that didn't fit"), buffer.NumDropped(), 8 + 8 + 2 + 1);
+
+    expected.SetNum(8);
+    for (int32 i = 0; i < 4; i++) {
+        expected.Emplace(130 + i * 10, 3, 0x91, i, 100);
+        expected.Emplace(130 + i * 10 + 5, 3, 0x81, i, 0);
+    }
+    TestTrue(TEXT("only notes left"), BlockOf(buffer, false) == expected);
+    TestEqual(TEXT("peak"), buffer.PeakNum(), 16);
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferCoalesceTest, "RNBO.MIDIBuffer.Coalesce", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferCoalesceTest::RunTest(const FString& Parameters)
+{
+    FMIDIBuffer buffer(BlockSettings(), 4, 0, EMIDIOverflowPolicy::Coalesce);
+
+    buffer.Push(Message(0, 0xB0, 1, 10));
+    buffer.Push(Message(1, 0xB0, 2, 20));
+    buffer.Push(Message(2, 0xB0, 1, 30));
+    buffer.Push(Message(3, 0xE0, 0, 64));
+
+    // replaces the latest value of the same controller, then of the pitch bend
+    buffer.Push(Message(4, 0xB0, 1, 40));
+    buffer.Push(Message(5, 0xE0, 0, 70));
+    TestEqual(TEXT("replaced"), buffer.NumDropped(), 2);
+
+    // nothing to replace: another controller, another channel, a note
+    buffer.Push(Message(6, 0xB0, 3, 1));
+    buffer.Push(Message(6, 0xE1, 0, 1));
+    buffer.Push(FMIDIPacket::NoteOn(6, 60, 100, 0));
+    buffer.PushNote(6, 10, 0, 60, 100, 0);
+    TestEqual(TEXT("replaced and dropped"), buffer.NumDropped(), 2 + 3 + 2);
+
+    TArray<FPacketKey> expected;
+    expected.Emplace(0, 3, 0xB0, 1, 10);
+    expected.Emplace(1, 3, 0xB0, 2, 20);
+    expected.Emplace(4, 3, 0xB0, 1, 40);
+    expected.Emplace(5, 3, 0xE0, 0, 70);
+    TestTrue(TEXT("latest values kept"), BlockOf(buffer, false) == expected);
+    TestEqual(TEXT("peak"), buffer.PeakNum(), 4);
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferPendingOffsTest, "RNBO.MIDIBuffer.PendingOffs", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferPendingOffsTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+    constexpr int32 Duration = 10000;
+    FMIDIBuffer buffer(settings, 8, 0, EMIDIOverflowPolicy::DropNewest);
+
+    // offs scheduled past the block still take a slot each: 4 notes fill the buffer
+    for (int32 i = 0; i < 4; i++) {
+        buffer.PushNote(i, Duration, 0, static_cast<uint8_t>(i), 100, 0);
+    }
+    TestEqual(TEXT("ons in the block"), buffer.NumInBlock(), 4);
+    TestEqual(TEXT("peak with the pending offs"), buffer.PeakNum(), 8);
+
+    // a new note, one overlapping a held note, and a controller don't fit
+    buffer.PushNote(10, Duration, 0, 10, 100, 0);
+    buffer.PushNote(10, Duration, 0, 0, 100, 0);
+    buffer.Push(Message(10, 0xB0, 1, 1));
+    TestEqual(TEXT("dropped"), buffer.NumDropped(), 2 + 2 + 1);
+
+    // once the ons are out, only the slots of the pending offs are taken
+    buffer.AdvanceBlock();
+    for (int32 i = 0; i < 5; i++) {
+        buffer.Push(Message(i, 0xB0, 1, static_cast<uint8_t>(i)));
+    }
+    TestEqual(TEXT("controllers next to the pending offs"), buffer.NumInBlock(), 4);
+    TestEqual(TEXT("dropped"), buffer.NumDropped(), 2 + 2 + 1 + 1);
+
+    // every held note gets its off, when it was scheduled
+    TArray<FPacketKey> offs;
+    for (int32 block = 1; block * frames <= Duration + 3; block++) {
+        buffer.AdvanceBlock();
+        for (const auto& key : BlockOf(buffer, false)) {
+            offs.Emplace(std::get<0>(key) + (block + 1) * frames, std::get<1>(key), std::get<2>(key), std::get<3>(key), std::get<4>(key));
+        }
+    }
+    TArray<FPacketKey> expected;
+    for (int32 i = 0; i < 4; i++) {
+        expected.Emplace(i + Duration, 3, 0x80, i, 0);
+    }
+    TestTrue(TEXT("offs"), offs == expected);
+    TestEqual(TEXT("peak"), buffer.PeakNum(), 8);
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferOverflowTest, "RNBO.MIDIBuffer.Overflow", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferOverflowTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+    constexpr int32 Capacity = 32;
+    constexpr int32 MaxDuration = 3000;
+    static const uint8_t Statuses[] = { 0xA0, 0xB0, 0xC0, 0xD0, 0xE0 };
+
+    // a small buffer kept overflowing with notes and controllers: whatever the policy, blocks stay in order, every
+    // note on gets its off, and each packet pushed either comes out or is counted as dropped
+    for (const auto policy : { EMIDIOverflowPolicy::DropOldest, EMIDIOverflowPolicy::DropNewest, EMIDIOverflowPolicy::Coalesce }) {
+        int32 overflows = 0;
+        for (int32 seed = 0; seed < 100; seed++) {
+            FRandomStream rng(seed);
+            FMIDIBuffer buffer(settings, Capacity, 0, policy);
+            // sounding notes, per channel and number
+            TArray<int32> held;
+            held.SetNumZeroed(2 * 128);
+            int32 pushed = 0;
+            int32 received = 0;
+            int32 last = 0;
+
+            // reads the current block, then moves on to the next one
+            auto advance = [&](int32 step) {
+                if (buffer.NumInBlock() > Capacity) {
+                    AddError(FString::Printf(TEXT("policy %d seed %d step %d: %d packets in a block"), static_cast<int32>(policy), seed, step, buffer.NumInBlock()));
+                    return false;
+                }
+                int32 previous = 0;
+                for (int32 i = 0; i < buffer.NumInBlock(); i++) {
+                    const auto p = buffer[i];
+                    if (p.Frame() < previous || p.Frame() >= frames) {
+                        AddError(FString::Printf(TEXT("policy %d seed %d step %d: packet %d at frame %d out of order"), static_cast<int32>(policy), seed, step, i, p.Frame()));
+                        return false;
+                    }
+                    previous = p.Frame();
+
+                    const auto& d = p.Data();
+                    const uint8_t status = d[0] & 0xF0;
+                    if (p.Length() == 3 && (status == 0x80 || status == 0x90)) {
+                        int32& count = held[(d[0] & 0x0F) * 128 + d[1]];
+                        count += status == 0x90 ? 1 : -1;
+                        if (count < 0 || count > 1) {
+                            AddError(FString::Printf(TEXT("policy %d seed %d step %d: note %d on channel %d sounding %d times"), static_cast<int32>(policy), seed, step, d[1], d[0] & 0x0F, count));
+                            return false;
+                        }
+                    }
+                }
+                received += buffer.NumInBlock();
+                buffer.AdvanceBlock();
+                last = 0;
+                return true;
+            };
+
+            for (int32 step = 0; step < 2000; step++) {
+                const int32 op = rng.RandRange(0, 9);
+                if (op < 1 || (op >= 5 && last >= frames - 1)) {
+                    if (!advance(step)) {
+                        return false;
+                    }
+                }
+                else if (op < 5) {
+                    const uint8_t status = Statuses[rng.RandRange(0, 4)] | static_cast<uint8_t>(rng.RandRange(0, 1));
+                    buffer.Push(Message(rng.RandRange(0, 1999), status, static_cast<uint8_t>(rng.RandRange(0, 3)), static_cast<uint8_t>(rng.RandRange(0, 127))));
+                    pushed++;
+                }
+                else {
+                    // trigger frames come in order. Not twice at the same frame, the first note would be cut to
+                    // nothing, which isn't what's tested here
+                    const int32 start = last + rng.RandRange(1, frames - 1 - last);
+                    last = start;
+                    buffer.PushNote(start, rng.RandRange(1, MaxDuration), static_cast<uint8_t>(rng.RandRange(0, 1)), static_cast<uint8_t>(rng.RandRange(0, 3)), 100, 0);
+                    pushed += 2;
+                }
+                if (buffer.PeakNum() > Capacity) {
+                    AddError(FString::Printf(TEXT("policy %d seed %d step %d: peak %d"), static_cast<int32>(policy), seed, step, buffer.PeakNum()));
+                    return false;
+                }
+            }
+
+            // let everything pending come out
+            for (int32 block = 0; block * frames < MaxDuration + 2000 + frames; block++) {
+                if (!advance(2000 + block)) {
+                    return false;
+                }
+            }
+            for (int32 i = 0; i < held.Num(); i++) {
+                if (held[i] != 0) {
+                    AddError(FString::Printf(TEXT("policy %d seed %d: note %d on channel %d left hanging"), static_cast<int32>(policy), seed, i % 128, i / 128));
+                    return false;
+                }
+            }
+            if (received + buffer.NumDropped() != pushed) {
+                AddError(FString::Printf(TEXT("policy %d seed %d: %d packets pushed, %d received and %d dropped"), static_cast<int32>(policy), seed, pushed, received, buffer.NumDropped()));
+                return false;
+            }
+            overflows += buffer.NumDropped() > 0 ? 1 : 0;
+        }
+        TestTrue(TEXT("the buffer overflowed"), overflows > 50);
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferLongMessagesTest, "RNBO.MIDIBuffer.LongMessages", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferLongMessagesTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+    constexpr int32 MaxLength = 600;
+
+    // room for all of them at once, with the length each one is stored after
+    int32 payloadBytes = 0;
+    for (int32 length = 4; length <= MaxLength; length++) {
+        payloadBytes += static_cast<int32>(sizeof(uint32)) + length;
+    }
+
+    // every length, pushed out of frame order so most of them are inserted between the others
+    for (const bool bFixed : { false, true }) {
+        FMIDIBuffer buffer = bFixed ? FMIDIBuffer(settings, 1024, payloadBytes, EMIDIOverflowPolicy::DropNewest) : FMIDIBuffer(settings, 0, 0, EMIDIOverflowPolicy::DropNewest);
+        auto frameOf = [&](int32 length) { return (length * 37) % frames; };
+
+        for (int32 pass = 0; pass < 2; pass++) {
+            for (int32 length = 1; length <= MaxLength; length++) {
+                const auto bytes = LongMessage(length, pass);
+                buffer.Push(FMIDIPacket(frameOf(length), bytes.Num(), bytes.GetData()));
+            }
+            TestEqual(TEXT("dropped"), buffer.NumDropped(), 0);
+            if (!TestEqual(TEXT("messages"), buffer.NumInBlock(), MaxLength)) {
+                return false;
+            }
+
+            // in frame order, and in push order at the same frame
+            int32 i = 0;
+            for (int32 frame = 0; frame < frames; frame++) {
+                for (int32 length = 1; length <= MaxLength; length++) {
+                    if (frameOf(length) != frame) {
+                        continue;
+                    }
+                    const auto p = buffer[i++];
+                    if (p.Frame() != frame || !HasBytes(p, LongMessage(length, pass))) {
+                        AddError(FString::Printf(TEXT("fixed %d pass %d: packet %d isn't the %d byte message pushed at frame %d"), bFixed, pass, i - 1, length, frame));
+                        return false;
+                    }
+                }
+            }
+
+            // once they are read the arena starts over, the second pass needs all of it again
+            buffer.AdvanceBlock();
+        }
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferPayloadArenaTest, "RNBO.MIDIBuffer.PayloadArena", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferPayloadArenaTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+    FMIDIBuffer buffer(settings, 16, 64, EMIDIOverflowPolicy::DropNewest);
+
+    // 4 bytes of length and the message each: 44, then 34 more don't fit, 20 more fill it exactly
+    const auto a = LongMessage(40, 0);
+    const auto b = LongMessage(30, 1);
+    const auto c = LongMessage(16, 2);
+    buffer.Push(FMIDIPacket(0, a.Num(), a.GetData()));
+    buffer.Push(FMIDIPacket(1, b.Num(), b.GetData()));
+    buffer.Push(Message(2, 0xB0, 1, 1));
+    buffer.Push(FMIDIPacket(3, c.Num(), c.GetData()));
+    TestEqual(TEXT("dropped when the arena is full"), buffer.NumDropped(), 1);
+    if (!TestEqual(TEXT("packets"), buffer.NumInBlock(), 3)) {
+        return false;
+    }
+    TestTrue(TEXT("first message"), HasBytes(buffer[0], a));
+    TestEqual(TEXT("controller"), buffer[1].Length(), static_cast<size_t>(3));
+    TestTrue(TEXT("message filling the arena"), HasBytes(buffer[2], c));
+
+    // the arena starts over once its messages are read
+    buffer.AdvanceBlock();
+    const auto d = LongMessage(56, 3);
+    buffer.Push(FMIDIPacket(frames + 10, d.Num(), d.GetData()));
+    TestEqual(TEXT("dropped after advancing"), buffer.NumDropped(), 1);
+
+    // but not while one is still to come
+    buffer.AdvanceBlock();
+    buffer.Push(FMIDIPacket(20, a.Num(), a.GetData()));
+    TestEqual(TEXT("dropped with a message pending"), buffer.NumDropped(), 2);
+    if (!TestEqual(TEXT("pending message"), buffer.NumInBlock(), 1)) {
+        return false;
+    }
+    TestTrue(TEXT("pending message"), HasBytes(buffer[0], d));
+
+    buffer.AdvanceBlock();
+    buffer.Push(FMIDIPacket(0, d.Num(), d.GetData()));
+    TestEqual(TEXT("dropped once it has been read"), buffer.NumDropped(), 2);
+    TestTrue(TEXT("message after starting over"), buffer.NumInBlock() == 1 && HasBytes(buffer[0], d));
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOMIDIBufferRepushTest, "RNBO.MIDIBuffer.Repush", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOMIDIBufferRepushTest::RunTest(const FString& Parameters)
+{
+    const auto settings = BlockSettings();
+    const int32 frames = settings.GetNumFramesPerBlock();
+
+    // a packet read from a buffer points into its arena. Pushed back while the arena grows, it has to be copied
+    // from where its bytes moved to
+    {
+        FMIDIBuffer buffer(settings, 0, 0, EMIDIOverflowPolicy::DropNewest);
+        const auto a = LongMessage(100, 0);
+        buffer.Push(FMIDIPacket(0, a.Num(), a.GetData()));
+        for (int32 i = 1; i < 64; i++) {
+            buffer.Push(buffer[i - 1].CloneTo(i));
+        }
+        for (int32 i = 0; i < buffer.NumInBlock(); i++) {
+            if (!HasBytes(buffer[i], a)) {
+                AddError(FString::Printf(TEXT("growing: copy %d differs"), i));
+                return false;
+            }
+        }
+    }
+
+    // or dropping the packet itself to make room may free the arena, and the copy lands over the bytes it copies
+    {
+        FMIDIBuffer buffer(settings, 2, 1024, EMIDIOverflowPolicy::DropOldest);
+        const auto a = LongMessage(8, 0);
+        const auto b = LongMessage(300, 1);
+        buffer.Push(FMIDIPacket(0, a.Num(), a.GetData()));
+        buffer.Push(FMIDIPacket(frames + 10, b.Num(), b.GetData()));
+
+        // a is gone but b still sits after it in the arena, the buffer is full
+        buffer.AdvanceBlock();
+        buffer.Push(Message(11, 0xB0, 1, 1));
+        buffer.Push(buffer[0].CloneTo(20));
+        TestEqual(TEXT("dropped the packet pushed back"), buffer.NumDropped(), 1);
+        if (!TestEqual(TEXT("packets"), buffer.NumInBlock(), 2)) {
+            return false;
+        }
+        TestEqual(TEXT("controller"), buffer[0].Frame(), 11);
+        TestTrue(TEXT("message pushed back"), buffer[1].Frame() == 20 && HasBytes(buffer[1], b));
+    }
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
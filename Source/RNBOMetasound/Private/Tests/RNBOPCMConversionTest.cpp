@@ -0,0 +1,60 @@
+#include "DSP/FloatArrayMath.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOPCMConversionBenchmark, "RNBO.WaveBufferCache.PCM16ConversionBenchmark", EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+
+bool FRNBOPCMConversionBenchmark::RunTest(const FString& Parameters)
+{
+    // a minute of stereo at 48 kHz, converted the way WaveAssetDataRef::Update used to and the way the cache does now.
+    // Both keep the interleaved layout buffer~ expects, there is no deinterleaving step to time
+    constexpr int32 NumSamples = 48000 * 60 * 2;
+    constexpr int32 NumRuns = 10;
+
+    TArray<int16> pcm;
+    pcm.SetNumUninitialized(NumSamples);
+    FRandomStream rng(1);
+    for (auto& s : pcm) {
+        s = static_cast<int16>(rng.RandRange(-32768, 32767));
+    }
+
+    TArray<float> scalar;
+    TArray<float> vectorized;
+    vectorized.SetNumUninitialized(NumSamples);
+
+    double scalarSeconds = 0.0;
+    double vectorizedSeconds = 0.0;
+    for (int32 run = 0; run < NumRuns; run++) {
+        double begin = FPlatformTime::Seconds();
+        scalar.Reset();
+        // the old loop, which scaled by INT16_MAX
+        const float div = static_cast<float>(INT16_MAX);
+        for (int32 i = 0; i < NumSamples; i++) {
+            scalar.Push(static_cast<float>(pcm[i]) / div);
+        }
+        scalarSeconds += FPlatformTime::Seconds() - begin;
+
+        begin = FPlatformTime::Seconds();
+        Audio::ArrayPcm16ToFloat(MakeArrayView(pcm.GetData(), NumSamples), MakeArrayView(vectorized.GetData(), NumSamples));
+        vectorizedSeconds += FPlatformTime::Seconds() - begin;
+    }
+
+    // ArrayPcm16ToFloat scales by 1 / 32768 instead, at most one part in 32767 quieter
+    for (int32 i = 0; i < NumSamples; i++) {
+        if (!FMath::IsNearlyEqual(scalar[i], vectorized[i], 1e-4f)) {
+            AddError(FString::Printf(TEXT("sample %d: %f converted to %f, expected %f"), i, static_cast<float>(pcm[i]), vectorized[i], scalar[i]));
+            return false;
+        }
+    }
+
+    const double samples = static_cast<double>(NumSamples) * NumRuns;
+    AddInfo(FString::Printf(TEXT("PCM16 to float: scalar push %.1f Msamples/s, ArrayPcm16ToFloat %.1f Msamples/s"),
+                            samples / FMath::Max(scalarSeconds, 1e-9) / 1e6,
+                            samples / FMath::Max(vectorizedSeconds, 1e-9) / 1e6));
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,89 @@
+#include "RNBOBufferCache.h"
+
+#include "Audio.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+#include "Sound/SoundWave.h"
+#include "UObject/Package.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITORONLY_DATA
+
+namespace
+{
+    using RNBOMetasound::FDecodedWavePtr;
+    using RNBOMetasound::FWaveBufferCache;
+
+    // the smallest range Decode splits a wave in
+    constexpr int32 RangeFrames = 16384;
+
+    // a transient wave holding Samples, compressed as PCM like an imported asset would be
+    USoundWave* MakePCMWave(const TArray<int16>& Samples, int32 NumChannels, int32 SampleRate)
+    {
+        TArray<uint8> file;
+        SerializeWaveFile(file, reinterpret_cast<const uint8*>(Samples.GetData()), Samples.Num() * sizeof(int16), NumChannels, SampleRate);
+
+        USoundWave* Wave = NewObject<USoundWave>(GetTransientPackage(), NAME_None, RF_Transient);
+        Wave->RawData.UpdatePayload(FSharedBuffer::Clone(file.GetData(), file.Num()));
+        Wave->NumChannels = NumChannels;
+        Wave->SetSampleRate(SampleRate);
+        Wave->TotalSamples = Samples.Num() / NumChannels;
+        Wave->Duration = static_cast<float>(Wave->TotalSamples) / SampleRate;
+        Wave->SetSoundAssetCompressionType(ESoundAssetCompressionType::PCM, false);
+        Wave->InvalidateCompressedData(true, false);
+        Wave->InitAudioResource(Wave->GetRuntimeFormat());
+        return Wave;
+    }
+} // namespace
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRNBOWaveParallelDecode, "RNBO.WaveBufferCache.ParallelDecode", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FRNBOWaveParallelDecode::RunTest(const FString& Parameters)
+{
+    // a few full ranges and a partial one, stereo so a range start that is off by a sample swaps the channels
+    constexpr int32 NumChannels = 2;
+    constexpr int32 NumFrames = RangeFrames * 3 + 1000;
+
+    TArray<int16> pcm;
+    pcm.SetNumUninitialized(NumFrames * NumChannels);
+    FRandomStream rng(1);
+    for (auto& s : pcm) {
+        s = static_cast<int16>(rng.RandRange(-32768, 32767));
+    }
+
+    USoundWave* Wave = MakePCMWave(pcm, NumChannels, 48000);
+    FSoundWaveProxyPtr WaveProxy = Wave->CreateSoundWaveProxy();
+    if (!TestTrue(TEXT("wave proxy"), WaveProxy.IsValid())) {
+        return false;
+    }
+
+    FDecodedWavePtr serial = FWaveBufferCache::Decode(WaveProxy, 0);
+    FDecodedWavePtr parallel = FWaveBufferCache::Decode(WaveProxy, RangeFrames);
+    if (!TestTrue(TEXT("serial decode"), serial.IsValid()) || !TestTrue(TEXT("parallel decode"), parallel.IsValid())) {
+        return false;
+    }
+
+    TestEqual(TEXT("serial samples"), serial->Num(), pcm.Num());
+    TestEqual(TEXT("parallel samples"), parallel->Num(), serial->Num());
+    TestEqual(TEXT("parallel channels"), parallel->NumChannels, serial->NumChannels);
+
+    // the ranges must line up with the serial decode exactly, not just sound alike
+    const int32 num = FMath::Min(serial->Num(), parallel->Num());
+    for (int32 i = 0; i < num; i++) {
+        if (serial->GetData()[i] != parallel->GetData()[i]) {
+            AddError(FString::Printf(TEXT("sample %d (frame %d, range %d): parallel decoded %f, serial %f"),
+                                     i, i / NumChannels, i / NumChannels / RangeFrames, parallel->GetData()[i], serial->GetData()[i]));
+            return false;
+        }
+    }
+
+    // and both hold the wave that went in
+    for (int32 i = 0; i < FMath::Min(num, pcm.Num()); i++) {
+        if (serial->GetData()[i] != static_cast<float>(pcm[i]) / 32768.0f) {
+            AddError(FString::Printf(TEXT("sample %d: decoded %f from %d"), i, serial->GetData()[i], pcm[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS && WITH_EDITORONLY_DATA
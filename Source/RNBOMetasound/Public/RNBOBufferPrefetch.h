@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "Sound/SoundWave.h"
+
+#include "RNBOBufferPrefetch.generated.h"
+
+namespace RNBOMetasound {
+struct FDecodedWave;
+}
+
+/** Decoded waves kept in memory by a prefetch, RNBO nodes bind them without decoding as long as this is referenced. */
+UCLASS(BlueprintType)
+class RNBOMETASOUND_API URNBOPrefetchedBuffers : public UObject
+{
+    GENERATED_BODY()
+
+  public:
+    /** Let go of the prefetched waves, they are freed once no RNBO node uses them either. */
+    UFUNCTION(BlueprintCallable, Category = "RNBO")
+    void Release();
+
+    UFUNCTION(BlueprintPure, Category = "RNBO")
+    int32 Num() const { return Waves.Num(); }
+
+    void Add(TSharedPtr<const RNBOMetasound::FDecodedWave, ESPMode::ThreadSafe> Wave);
+
+  private:
+    TArray<TSharedPtr<const RNBOMetasound::FDecodedWave, ESPMode::ThreadSafe>> Waves;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FRNBOBufferPrefetchProgress, int32, NumLoaded, int32, NumWaves, URNBOPrefetchedBuffers*, Buffers);
+
+/** Decode sound waves into the buffer~ cache ahead of time, a loading screen for instance.
+ *
+ * Keep Buffers referenced for as long as the waves should stay decoded.
+ */
+UCLASS()
+class RNBOMETASOUND_API URNBOBufferPrefetch : public UBlueprintAsyncActionBase
+{
+    GENERATED_BODY()
+
+  public:
+    /** SampleRate is the rate of the graphs that will use the waves, only needed with au.RNBO.WaveBufferCache.ResampleToGraphRate. */
+    UFUNCTION(BlueprintCallable, Category = "RNBO", meta = (BlueprintInternalUseOnly = "true", WorldContext = "WorldContextObject", DisplayName = "Prefetch RNBO Buffers"))
+    static URNBOBufferPrefetch* PrefetchRNBOBuffers(UObject* WorldContextObject, const TArray<USoundWave*>& SoundWaves, float SampleRate = 0.0f);
+
+    /** Called on the game thread as each wave is loaded, waves that fail to load count as loaded. */
+    UPROPERTY(BlueprintAssignable)
+    FRNBOBufferPrefetchProgress OnProgress;
+
+    /** Called on the game thread once every wave has been loaded. */
+    UPROPERTY(BlueprintAssignable)
+    FRNBOBufferPrefetchProgress OnCompleted;
+
+    virtual void Activate() override;
+
+  private:
+    void WaveLoaded(TSharedPtr<const RNBOMetasound::FDecodedWave, ESPMode::ThreadSafe> Wave);
+
+    UPROPERTY()
+    TArray<TObjectPtr<USoundWave>> SoundWaves;
+
+    UPROPERTY()
+    TObjectPtr<URNBOPrefetchedBuffers> Buffers;
+
+    float SampleRate = 0.0f;
+
+    int32 NumLoaded = 0;
+};
@@ -6,6 +6,11 @@
 
 namespace RNBOMetasound {
 
+/** A MIDI message at a frame.
+ *
+ * Messages up to 3 bytes are held inline. A longer one (SysEx) refers to its bytes instead of copying them: they have to
+ * outlive the packet, FMIDIBuffer::Push copies them into the buffer (it may also be a packet read from that buffer).
+ */
 class RNBOMETASOUND_API FMIDIPacket
 {
   public:
@@ -17,7 +22,10 @@ class RNBOMETASOUND_API FMIDIPacket
     static FMIDIPacket NoteOff(int32 frame, uint8_t num, uint8_t vel, uint8_t chan);
 
     int32 Frame() const;
+    // the first 3 bytes, enough for anything but SysEx
     const std::array<uint8_t, 3>& Data() const;
+    // all Length() bytes
+    const uint8_t* Bytes() const;
     size_t Length() const;
 
     /** Advance internal frame counters by specific frame count. */
@@ -32,14 +40,47 @@ class RNBOMETASOUND_API FMIDIPacket
   private:
     int32 mFrame;
     std::array<uint8_t, 3> mData;
-    uint8_t mLength;
+    uint32 mLength;
+    const uint8_t* mLongData = nullptr; // not owned, when mLength is more than mData holds
 };
 
+// What a buffer with a fixed capacity does with packets that don't fit
+enum class EMIDIOverflowPolicy : uint8
+{
+    // drop the earliest packets other than note ons and offs to make room, or the new packet if there aren't enough
+    DropOldest,
+    // drop the packet (or note) being pushed
+    DropNewest,
+    // replace a pending packet for the same controller (CC, pitch bend, pressure, program change), or drop the new one
+    Coalesce
+};
+
+/** Time ordered MIDI packets, the ones in the current block first.
+ *
+ * Packets are kept in a ring with absolute frame times, so advancing a block only moves the read position, and packets
+ * pushed in time order (the usual case) are appended without moving anything.
+ *
+ * The ring has a fixed capacity by default, au.RNBO.MIDIBuffer.Capacity packets, so pushing never allocates. Packets
+ * that don't fit are handled according to au.RNBO.MIDIBuffer.OverflowPolicy.
+ *
+ * Messages longer than 3 bytes are copied into a bump arena of au.RNBO.MIDIBuffer.PayloadBytes, which starts over
+ * once no long message is pending, normally on the AdvanceBlock after they are read. A long message that doesn't fit is
+ * dropped.
+ */
 class RNBOMETASOUND_API FMIDIBuffer
 {
   public:
     FMIDIBuffer(const Metasound::FOperatorSettings& InSettings);
 
+    /** A buffer holding up to InCapacity packets (rounded up to a power of 2) and InPayloadBytes of long messages, or
+     * growing as needed if InCapacity is 0.
+     */
+    FMIDIBuffer(const Metasound::FOperatorSettings& InSettings, int32 InCapacity, int32 InPayloadBytes, EMIDIOverflowPolicy InPolicy);
+
+    static int32 DefaultCapacity();
+    static int32 DefaultPayloadBytes();
+    static EMIDIOverflowPolicy DefaultOverflowPolicy();
+
     /** Advance internal frame counters by block size. */
     void AdvanceBlock();
 
@@ -49,23 +90,132 @@ class RNBOMETASOUND_API FMIDIBuffer
      *
      * @param InIndex - Index of packet. Must be a value between 0 and Num().
      *
-     * @return The packet
+     * @return The packet, with its frame relative to the start of the current block. The bytes of a long message
+     * belong to the buffer and are valid until it is next changed.
      */
-    const FMIDIPacket& operator[](int32 index) const;
+    FMIDIPacket operator[](int32 index) const;
 
     void Push(FMIDIPacket packet);
 
-    // Pushes a new note and manages updating any overlapping matching notes
+    /** Pushes a new note and manages updating any overlapping matching notes.
+     *
+     * Overlaps are resolved against the notes previously pushed with PushNote, which are expected in time order (as
+     * trigger frames are).
+     */
     void PushNote(int32 start, int32 dur, uint8_t chan, uint8_t note, uint8_t onvel, uint8_t offvel);
 
     void Reset();
 
+    /** Allocate what PushNote needs up front, so it doesn't allocate on first use. */
+    void ReserveNotes();
+
+    /** Packets (or notes, counted as 2) dropped because the buffer was full, including replaced ones.
+     *
+     * Blocks that drop packets are also logged to LogMetaSound at Verbose.
+     */
+    int32 NumDropped() const;
+
+    /** Most packets held at once, including note offs scheduled by PushNote. */
+    int32 PeakNum() const;
+
   private:
+    // a packet as stored in the ring, 8 bytes
+    struct FEvent
+    {
+        uint32 Time; // absolute frame, wraps around
+        std::array<uint8_t, 3> Data; // or the offset of a long message in Payloads, little endian
+        uint8_t Length; // or LongLength
+    };
+
+    // the message is in Payloads, after its 4 byte length
+    static constexpr uint8_t LongLength = 0xFF;
+    static constexpr int32 MaxPayloadBytes = 1 << 24;
+    // longer notes are cut, about 6 hours at 48 kHz
+    static constexpr int32 MaxNoteFrames = 1 << 30;
+
+    // the last note PushNote pushed on a channel and note number
+    struct FNoteState
+    {
+        uint32 OnTime = 0;
+        uint32 OffTime = 0;
+        int32 OffIndex = INDEX_NONE; // in PendingOffs, INDEX_NONE once the off is in the ring
+        bool bActive = false; // until the off has gone out, so OnTime and OffTime are never far from BlockStart
+    };
+
+    // a note off PushNote scheduled past the current block, kept out of the ring until its block comes up so moving
+    // it doesn't shift anything
+    struct FPendingOff
+    {
+        uint32 Time;
+        uint32 Seq; // orders offs at the same time by push order
+        uint16 Note; // index in Notes
+        uint8_t Velocity;
+    };
+
+    FEvent& At(int32 index) { return Events[(Head + index) & (Events.Num() - 1)]; }
+    const FEvent& At(int32 index) const { return Events[(Head + index) & (Events.Num() - 1)]; }
+    // times wrap around, always compare them through this signed difference
+    int32 FrameOf(uint32 time) const { return static_cast<int32>(time - BlockStart); }
+    int32 FrameOf(const FEvent& event) const { return FrameOf(event.Time); }
+
+    // index of the first packet after frame
+    int32 UpperBound(int32 frame) const;
+    // index of a packet at frame starting with status and note, INDEX_NONE if there is none
+    int32 Find(int32 frame, uint8_t status, uint8_t note) const;
+
+    // make room for num more packets according to Policy, returns false if they should be dropped
+    bool MakeRoom(int32 num, const FMIDIPacket* packet);
+    // drop the num earliest packets that aren't notes, returns false if there aren't that many
+    bool DropOldest(int32 num);
+    static bool IsNote(const FEvent& e);
+    // check that a long message fits in Payloads, growing it if the capacity isn't fixed
+    bool HasPayloadRoom(size_t length);
+    // keep count of the long messages in the ring as packets go, expects index to be valid
+    void Forget(int32 index);
+    // mark the note a scheduled off belongs to inactive as the off goes
+    void ForgetNote(const FEvent& e);
+    // index of a packet packet can replace, INDEX_NONE if there is none
+    int32 FindCoalescable(const FMIDIPacket& packet) const;
+
+    // shift whichever side of index is shorter
+    void Insert(int32 index, const FMIDIPacket& packet);
+    void RemoveAt(int32 index);
+    void Grow(int32 MinSize);
+
+    // min heap of PendingOffs, keeping FNoteState::OffIndex up to date
+    bool IsBefore(const FPendingOff& a, const FPendingOff& b) const;
+    void PushOff(uint16 note, uint32 time, uint8_t velocity);
+    void RemoveOff(int32 index);
+    void SiftUp(int32 index);
+    void SiftDown(int32 index);
+    void Place(int32 index, const FPendingOff& off);
+    // move the offs that fall in the current block into the ring
+    void MergeDueOffs();
+
     int32 NumFramesPerBlock = 0;
     int32 CountInBlock = 0;
-    int32 LastFrame = -1;
 
-    TArray<FMIDIPacket> Packets;
+    bool bFixedCapacity = false;
+    EMIDIOverflowPolicy Policy = EMIDIOverflowPolicy::DropNewest;
+    int32 Dropped = 0;
+    int32 DroppedReported = 0; // by AdvanceBlock's log
+    int32 Peak = 0;
+
+    uint32 BlockStart = 0; // absolute frame of the current block
+    int32 Head = 0;
+    int32 Count = 0;
+    TArray<FEvent> Events; // power of 2 size
+
+    TArray<uint8_t> Payloads;
+    int32 PayloadsUsed = 0;
+    int32 NumLong = 0;
+
+    // 16 channels x 128 notes, allocated by the first PushNote
+    TArray<FNoteState> Notes;
+    // at most one per note
+    TArray<FPendingOff> PendingOffs;
+    TArray<FPendingOff> DueOffs;
+    uint32 OffSeq = 0;
 };
 } // namespace RNBOMetasound
 
@@ -6,6 +6,7 @@ using System;
 using System.IO;
 using System.Globalization;
 using System.Text;
+using System.Text.Json;
 using System.Text.RegularExpressions;
 using System.Collections.Generic;
 
@@ -29,6 +30,8 @@ public class RNBOMetasound : ModuleRules
 			OperatorTemplate = streamReader.ReadToEnd();
 		}
 
+		CheckFixture(Path.Combine(ModuleDirectory, "Private", "Tests", "Fixtures", "AudioRateParam"));
+
 		var exportDir = Path.Combine(PluginDirectory, "Exports");
         if (!Directory.Exists(exportDir)) {
             throw new InvalidOperationException("RNBOMetasound cannot build without at least one export in the Exports directory");
@@ -95,6 +98,8 @@ public class RNBOMetasound : ModuleRules
 			new string[]
 			{
 				"Core",
+				"CoreUObject",
+				"Engine",
 				"MetasoundFrontend",
 				"MetasoundGraphCore",
 				"MetasoundStandardNodes",
@@ -107,8 +112,8 @@ public class RNBOMetasound : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
-				"CoreUObject",
-				"Engine",
+				"AudioPlatformConfiguration",
+				"Projects",
 				"SignalProcessing",
 				// ... add private dependencies that you statically link with here ...
 			}
@@ -127,17 +132,579 @@ public class RNBOMetasound : ModuleRules
 
 	string CreateMetaSound(string path) {
 		var descPath = Path.Combine(path, "description.json");
-        string descString = File.ReadAllText(descPath);
-
-        //get the name
-		JsonObject desc = JsonObject.Parse(descString);
-        var meta = desc.GetObjectField("meta");
-		string name = meta.GetStringField("rnboobjname");
-
-		return OperatorTemplate
-			.Replace("_OPERATOR_NAME_", name)
-            //TODO chunk for windows
-			.Replace("_OPERATOR_DESC_", String.Format("R\"RNBOLIT({0})RNBOLIT\"", descString))
-			;
+		string descString = File.ReadAllText(descPath);
+
+		using (JsonDocument doc = JsonDocument.Parse(descString))
+		{
+			JsonElement desc = doc.RootElement;
+
+			//get the name
+			var meta = desc.GetProperty("meta");
+			string name = meta.GetProperty("rnboobjname").GetString();
+
+			return OperatorTemplate
+				.Replace("_OPERATOR_NAME_", name)
+				.Replace("_OPERATOR_DESC_", CreateDescription(desc, name, path))
+				;
+		}
+	}
+
+	//generate the description of a fixture export and compare it with the one committed next to it, so changes to
+	//the generator that change its output don't go unnoticed
+	void CheckFixture(string path) {
+		var expectedPath = Path.Combine(path, "Description.expected");
+		if (!File.Exists(expectedPath)) {
+			return;
+		}
+		string actual;
+		using (JsonDocument doc = JsonDocument.Parse(File.ReadAllText(Path.Combine(path, "description.json"))))
+		{
+			JsonElement desc = doc.RootElement;
+			actual = CreateDescription(desc, desc.GetProperty("meta").GetProperty("rnboobjname").GetString(), path);
+		}
+		var expected = new StringBuilder();
+		foreach (var line in File.ReadAllLines(expectedPath)) {
+			if (!line.StartsWith("//")) {
+				expected.Append(line).Append('\n');
+			}
+		}
+		if (actual.Replace("\r\n", "\n") != expected.ToString()) {
+			throw new InvalidOperationException(String.Format("RNBOMetasound generated a different description for {0} than {1}:\n{2}", Path.Combine(path, "description.json"), expectedPath, actual));
+		}
+	}
+
+	//precompute the tables the operator needs from description.json, so nothing has to be parsed at runtime
+	string CreateDescription(JsonElement desc, string className, string exportPath) {
+		var output = new StringBuilder();
+
+		string displayName = null;
+		TryGetString(desc.GetProperty("meta"), "name", out displayName);
+		if (String.IsNullOrEmpty(displayName) || displayName == "untitled") {
+			displayName = className;
+		}
+
+		//numeric params
+		var parameters = new SortedList<int, string>(); //keyed by parameter index, the operator expects them in order
+		int paramCount = 0;
+		JsonElement paramList;
+		if (desc.TryGetProperty("parameters", out paramList) && paramList.ValueKind == JsonValueKind.Array) {
+			paramCount = paramList.GetArrayLength();
+			foreach (var p in paramList.EnumerateArray()) {
+				string type;
+				if (!TryGetString(p, "type", out type) || type != "ParameterTypeNumber") {
+					continue;
+				}
+				bool visible;
+				if (TryGetBool(p, "visible", out visible) && !visible) {
+					continue;
+				}
+				bool isInput = GetMetaBool(p, "in", true);
+				bool isOutput = GetMetaBool(p, "out", false);
+				if (!isInput && !isOutput) {
+					continue;
+				}
+
+				string paramName = p.GetProperty("name").GetString();
+				string paramDisplayName;
+				if (!TryGetString(p, "displayName", out paramDisplayName) || paramDisplayName.Length == 0) {
+					paramDisplayName = paramName;
+				}
+				string paramId;
+				if (!TryGetString(p, "paramId", out paramId)) {
+					paramId = paramName;
+				}
+				double initialValue;
+				if (!TryGetNumber(p, "initialValue", out initialValue)) {
+					initialValue = 0.0;
+				}
+
+				string paramType = IsBoolParam(p) ? "Bool" : (IsIntParam(p) ? "Int" : "Float");
+				int paramIndex = p.GetProperty("index").GetInt32();
+				parameters[paramIndex] = String.Format("{{ {0}, ERNBOParamType::{1}, {2}, {3}, {4}, {5}, {6}, {7} }}",
+					paramIndex,
+					paramType,
+					BoolLiteral(isInput),
+					BoolLiteral(isOutput),
+					FloatLiteral(initialValue),
+					TextLiteral(paramName),
+					TextLiteral(paramDisplayName),
+					TextLiteral(paramId));
+			}
+		}
+
+		//signal inlets, in channel order. An in~ the patch uses to modulate a parameter can be named after it with
+		//@meta param:<name>
+		var paramNames = new Dictionary<string, string>();
+		if (paramList.ValueKind == JsonValueKind.Array) {
+			foreach (var p in paramList.EnumerateArray()) {
+				string type;
+				if (!TryGetString(p, "type", out type) || type != "ParameterTypeNumber") {
+					continue;
+				}
+				string paramName = p.GetProperty("name").GetString();
+				string paramDisplayName;
+				if (!TryGetString(p, "displayName", out paramDisplayName) || paramDisplayName.Length == 0) {
+					paramDisplayName = paramName;
+				}
+				paramNames[paramName] = paramDisplayName;
+				string paramId;
+				if (TryGetString(p, "paramId", out paramId)) {
+					paramNames[paramId] = paramDisplayName;
+				}
+			}
+		}
+		var inputSignals = Signals(desc, "inlets", paramNames);
+		int numInputChannels = inputSignals.Count;
+		var outputSignals = Signals(desc, "outlets");
+
+		var inports = Ports(desc, "inports");
+		var outports = Ports(desc, "outports");
+
+		var dataRefs = new List<string>();
+		var dependencies = Dependencies(exportPath);
+		JsonElement dataRefList;
+		if (desc.TryGetProperty("externalDataRefs", out dataRefList) && dataRefList.ValueKind == JsonValueKind.Array) {
+			int index = 0;
+			foreach (var p in dataRefList.EnumerateArray()) {
+				string tag;
+				//only supporting buffer~ for now
+				if (!TryGetString(p, "tag", out tag) || tag == "buffer~") {
+					string id = p.GetProperty("id").GetString();
+					string file;
+					if (!dependencies.TryGetValue(id, out file)) {
+						TryGetString(p, "file", out file);
+					}
+					string blob = ImportBuffer(exportPath, className, index, file);
+					dataRefs.Add(String.Format("{{ {0}, {1}, {2} }}", index, TextLiteral(id), blob == null ? "nullptr" : TextLiteral(blob)));
+				}
+				index++;
+			}
+		}
+
+		double midiIn;
+		double midiOut;
+		bool transport;
+		if (!TryGetBool(desc, "transportUsed", out transport)) {
+			transport = true;
+		}
+
+		double channels;
+		if (TryGetNumber(desc, "numInputChannels", out channels)) {
+			numInputChannels = Math.Max(numInputChannels, (int)channels);
+		}
+
+		output.AppendLine("struct Description");
+		output.AppendLine("{");
+		output.AppendFormat("\tstatic constexpr const TCHAR* ClassName = {0};\n", TextLiteral(className));
+		output.AppendFormat("\tstatic constexpr const TCHAR* DisplayName = {0};\n", TextLiteral(displayName));
+		output.AppendFormat("\tstatic constexpr size_t ParamCount = {0};\n", paramCount);
+		output.AppendFormat("\tstatic constexpr size_t NumInputChannels = {0};\n", numInputChannels);
+		output.AppendFormat("\tstatic constexpr size_t NumOutputChannels = {0};\n", outputSignals.Count);
+		output.Append(Table("FRNBOExportParam", "Params", new List<string>(parameters.Values)));
+		output.Append(Table("FRNBOExportSignal", "InputSignals", inputSignals));
+		output.Append(Table("FRNBOExportSignal", "OutputSignals", outputSignals));
+		output.Append(Table("FRNBOExportPort", "Inports", inports));
+		output.Append(Table("FRNBOExportPort", "Outports", outports));
+		output.Append(Table("FRNBOExportDataRef", "DataRefs", dataRefs));
+		output.AppendFormat("\tstatic constexpr bool bMIDIIn = {0};\n", BoolLiteral(TryGetNumber(desc, "numMidiInputPorts", out midiIn) && midiIn > 0));
+		output.AppendFormat("\tstatic constexpr bool bMIDIOut = {0};\n", BoolLiteral(TryGetNumber(desc, "numMidiOutputPorts", out midiOut) && midiOut > 0));
+		output.AppendFormat("\tstatic constexpr bool bTransport = {0};\n", BoolLiteral(transport));
+		output.AppendLine("};");
+
+		return output.ToString();
+	}
+
+	//buffer~ id -> file from the export's dependencies.json, written when sample dependencies are copied
+	static Dictionary<string, string> Dependencies(string exportPath) {
+		var dependencies = new Dictionary<string, string>();
+		var path = Path.Combine(exportPath, "dependencies.json");
+		if (!File.Exists(path)) {
+			return dependencies;
+		}
+		using (JsonDocument doc = JsonDocument.Parse(File.ReadAllText(path)))
+		{
+			if (doc.RootElement.ValueKind != JsonValueKind.Array) {
+				return dependencies;
+			}
+			foreach (var d in doc.RootElement.EnumerateArray()) {
+				string id;
+				string file;
+				if (TryGetString(d, "id", out id) && TryGetString(d, "file", out file)) {
+					dependencies[id] = file;
+				}
+			}
+		}
+		return dependencies;
+	}
+
+	//convert a buffer~ @file sample to the blob layout FWaveBufferCache::MapFile expects and stage it with the plugin
+	//blobs are build products, written to the plugin's Intermediate directory and staged to its Resources directory
+	//returns the blob path relative to either, or null if there is nothing to import
+	string ImportBuffer(string exportPath, string className, int index, string file) {
+		if (String.IsNullOrEmpty(file)) {
+			return null;
+		}
+		var source = Path.Combine(exportPath, file);
+		if (!File.Exists(source)) {
+			source = Path.Combine(exportPath, "media", Path.GetFileName(file));
+		}
+		if (!File.Exists(source)) {
+			Console.WriteLine("RNBOMetasound: {0}: buffer~ file {1} not found in the export, it will start empty", className, file);
+			return null;
+		}
+
+		var relative = Path.Combine("RNBOBuffers", className, String.Format("{0}.rnbobuf", index));
+		var blob = Path.Combine(PluginDirectory, "Intermediate", relative);
+		ExternalDependencies.Add(source);
+
+		if (!File.Exists(blob) || File.GetLastWriteTimeUtc(blob) < File.GetLastWriteTimeUtc(source)) {
+			float[] samples;
+			int channels;
+			double sampleRate;
+			if (!ReadAudioFile(source, out samples, out channels, out sampleRate)) {
+				Console.WriteLine("RNBOMetasound: {0}: buffer~ file {1} isn't an uncompressed WAV or AIFF file, it will start empty", className, file);
+				return null;
+			}
+			WriteBlob(blob, samples, channels, sampleRate);
+		}
+
+		//mapped at runtime, so it has to stay a loose file when packaged
+		RuntimeDependencies.Add(Path.Combine("$(PluginDir)", "Resources", relative), blob, StagedFileType.NonUFS);
+		return relative.Replace('\\', '/');
+	}
+
+	//layout matches FDiskCacheHeader in RNBOBufferCache.cpp, followed by interleaved float samples
+	static void WriteBlob(string path, float[] samples, int channels, double sampleRate) {
+		Directory.CreateDirectory(Path.GetDirectoryName(path));
+		var tmp = path + ".tmp";
+		using (var writer = new BinaryWriter(File.Create(tmp)))
+		{
+			writer.Write((uint)0x524E4257);
+			writer.Write((uint)1);
+			writer.Write(channels);
+			writer.Write((float)sampleRate);
+			writer.Write((long)samples.Length);
+			writer.Write((ulong)0);
+			foreach (var s in samples) {
+				writer.Write(s);
+			}
+		}
+		File.Move(tmp, path, true);
+	}
+
+	static bool ReadAudioFile(string path, out float[] samples, out int channels, out double sampleRate) {
+		samples = null;
+		channels = 0;
+		sampleRate = 0.0;
+		byte[] data = File.ReadAllBytes(path);
+		if (data.Length < 12) {
+			return false;
+		}
+		string riff = Encoding.ASCII.GetString(data, 0, 4);
+		string form = Encoding.ASCII.GetString(data, 8, 4);
+		if (riff == "RIFF" && form == "WAVE") {
+			return ReadWav(data, out samples, out channels, out sampleRate);
+		}
+		if (riff == "FORM" && (form == "AIFF" || form == "AIFC")) {
+			return ReadAiff(data, form == "AIFC", out samples, out channels, out sampleRate);
+		}
+		return false;
+	}
+
+	static bool ReadWav(byte[] data, out float[] samples, out int channels, out double sampleRate) {
+		samples = null;
+		channels = 0;
+		sampleRate = 0.0;
+		int format = 0;
+		int bits = 0;
+		int offset = 12;
+		while (offset + 8 <= data.Length) {
+			string id = Encoding.ASCII.GetString(data, offset, 4);
+			int size = (int)BitConverter.ToUInt32(data, offset + 4);
+			int body = offset + 8;
+			size = Math.Min(size, data.Length - body);
+			if (id == "fmt " && size >= 16) {
+				format = BitConverter.ToUInt16(data, body);
+				channels = BitConverter.ToUInt16(data, body + 2);
+				sampleRate = BitConverter.ToUInt32(data, body + 4);
+				bits = BitConverter.ToUInt16(data, body + 14);
+				//WAVE_FORMAT_EXTENSIBLE, the sub format starts with the actual format tag
+				if (format == 0xFFFE && size >= 26) {
+					format = BitConverter.ToUInt16(data, body + 24);
+				}
+			}
+			else if (id == "data") {
+				if (channels <= 0 || (format != 1 && format != 3)) {
+					return false;
+				}
+				return ConvertSamples(data, body, size, bits, format == 3, false, channels, out samples);
+			}
+			//chunks are word aligned
+			offset = body + size + (size & 1);
+		}
+		return false;
+	}
+
+	static bool ReadAiff(byte[] data, bool isAifc, out float[] samples, out int channels, out double sampleRate) {
+		samples = null;
+		channels = 0;
+		sampleRate = 0.0;
+		int bits = 0;
+		bool isFloat = false;
+		bool littleEndian = false;
+		int offset = 12;
+		while (offset + 8 <= data.Length) {
+			string id = Encoding.ASCII.GetString(data, offset, 4);
+			int size = (int)ReadUInt32BE(data, offset + 4);
+			int body = offset + 8;
+			size = Math.Min(size, data.Length - body);
+			if (id == "COMM" && size >= 18) {
+				channels = (data[body] << 8) | data[body + 1];
+				bits = (data[body + 6] << 8) | data[body + 7];
+				sampleRate = ReadExtended(data, body + 8);
+				if (isAifc && size >= 22) {
+					string compression = Encoding.ASCII.GetString(data, body + 18, 4);
+					if (compression == "sowt") {
+						littleEndian = true;
+					}
+					else if (compression == "fl32" || compression == "FL32") {
+						isFloat = true;
+						bits = 32;
+					}
+					else if (compression == "fl64" || compression == "FL64") {
+						isFloat = true;
+						bits = 64;
+					}
+					else if (compression != "NONE") {
+						return false;
+					}
+				}
+			}
+			else if (id == "SSND" && size >= 8) {
+				if (channels <= 0) {
+					return false;
+				}
+				int dataOffset = (int)ReadUInt32BE(data, body);
+				return ConvertSamples(data, body + 8 + dataOffset, size - 8 - dataOffset, bits, isFloat, !littleEndian, channels, out samples);
+			}
+			offset = body + size + (size & 1);
+		}
+		return false;
+	}
+
+	static bool ConvertSamples(byte[] data, int offset, int size, int bits, bool isFloat, bool bigEndian, int channels, out float[] samples) {
+		samples = null;
+		int bytes = bits / 8;
+		if (size < 0 || (isFloat && bits != 32 && bits != 64) || (!isFloat && (bits < 8 || bits > 32 || bits % 8 != 0))) {
+			return false;
+		}
+		int frames = size / (bytes * channels);
+		samples = new float[frames * channels];
+		var sample = new byte[8];
+		for (int i = 0; i < samples.Length; i++) {
+			int o = offset + i * bytes;
+			//little endian copy of the sample
+			for (int b = 0; b < bytes; b++) {
+				sample[b] = bigEndian ? data[o + bytes - 1 - b] : data[o + b];
+			}
+			if (isFloat) {
+				samples[i] = bits == 32 ? BitConverter.ToSingle(sample, 0) : (float)BitConverter.ToDouble(sample, 0);
+			}
+			else if (bits == 8 && !bigEndian) {
+				//8 bit WAV is unsigned
+				samples[i] = (sample[0] - 128) / 128.0f;
+			}
+			else {
+				//sign extend from the top byte
+				long v = 0;
+				for (int b = bytes - 1; b >= 0; b--) {
+					v = (v << 8) | sample[b];
+				}
+				v = (v << (64 - bits)) >> (64 - bits);
+				samples[i] = (float)(v / Math.Pow(2.0, bits - 1));
+			}
+		}
+		return true;
+	}
+
+	static uint ReadUInt32BE(byte[] data, int offset) {
+		return ((uint)data[offset] << 24) | ((uint)data[offset + 1] << 16) | ((uint)data[offset + 2] << 8) | data[offset + 3];
+	}
+
+	//80 bit IEEE extended, used for the AIFF sample rate
+	static double ReadExtended(byte[] data, int offset) {
+		int exponent = ((data[offset] & 0x7F) << 8) | data[offset + 1];
+		ulong mantissa = 0;
+		for (int i = 0; i < 8; i++) {
+			mantissa = (mantissa << 8) | data[offset + 2 + i];
+		}
+		if (exponent == 0 && mantissa == 0) {
+			return 0.0;
+		}
+		double v = mantissa * Math.Pow(2.0, exponent - 16383 - 63);
+		return (data[offset] & 0x80) != 0 ? -v : v;
+	}
+
+	//paramNames maps parameter names and ids to display names, for inlets named after a parameter
+	static List<string> Signals(JsonElement desc, string selector, Dictionary<string, string> paramNames = null) {
+		var signals = new List<string>();
+		JsonElement list;
+		if (!desc.TryGetProperty(selector, out list) || list.ValueKind != JsonValueKind.Array) {
+			return signals;
+		}
+		foreach (var p in list.EnumerateArray()) {
+			string type;
+			if (!TryGetString(p, "type", out type) || type != "signal") {
+				continue;
+			}
+			string name = p.GetProperty("tag").GetString();
+			string tooltip = name;
+			string displayName = name;
+
+			//read comment and populate displayName if it exists
+			string comment;
+			if (TryGetString(p, "comment", out comment)) {
+				displayName = comment;
+			}
+			JsonElement meta;
+			if (p.TryGetProperty("meta", out meta) && meta.ValueKind == JsonValueKind.Object) {
+				string v;
+				string param;
+				if (paramNames != null && TryGetString(meta, "param", out param) && paramNames.TryGetValue(param, out v)) {
+					displayName = v + "~";
+				}
+				if (TryGetString(meta, "displayname", out v)) {
+					displayName = v;
+				}
+				if (TryGetString(meta, "tooltip", out v)) {
+					tooltip = v;
+				}
+			}
+			signals.Add(String.Format("{{ {0}, {1}, {2}, {3} }}", signals.Count, TextLiteral(name), TextLiteral(tooltip), TextLiteral(displayName)));
+		}
+		return signals;
+	}
+
+	static List<string> Ports(JsonElement desc, string selector) {
+		var ports = new List<string>();
+		JsonElement list;
+		if (!desc.TryGetProperty(selector, out list) || list.ValueKind != JsonValueKind.Array) {
+			return ports;
+		}
+		foreach (var p in list.EnumerateArray()) {
+			string tag = p.GetProperty("tag").GetString();
+			ports.Add(String.Format("{{ {0}, {1} }}", CharLiteral(tag), TextLiteral(tag)));
+		}
+		return ports;
+	}
+
+	static bool IsBoolParam(JsonElement p) {
+		double steps;
+		JsonElement e;
+		if (TryGetNumber(p, "steps", out steps) && steps == 2 && p.TryGetProperty("enumValues", out e) && e.ValueKind == JsonValueKind.Array && e.GetArrayLength() >= 2) {
+			var e0 = e[0];
+			var e1 = e[1];
+			return e0.ValueKind == JsonValueKind.Number && e1.ValueKind == JsonValueKind.Number && e0.GetDouble() == 0.0 && e1.GetDouble() == 1.0;
+		}
+		return false;
+	}
+
+	static bool IsIntParam(JsonElement p) {
+		bool isEnum;
+		return !IsBoolParam(p) && TryGetBool(p, "isEnum", out isEnum) && isEnum;
+	}
+
+	static bool GetMetaBool(JsonElement p, string key, bool defaultValue) {
+		JsonElement meta;
+		bool v;
+		if (p.TryGetProperty("meta", out meta) && meta.ValueKind == JsonValueKind.Object && TryGetBool(meta, key, out v)) {
+			return v;
+		}
+		return defaultValue;
+	}
+
+	static bool TryGetString(JsonElement e, string key, out string value) {
+		JsonElement v;
+		if (e.ValueKind == JsonValueKind.Object && e.TryGetProperty(key, out v) && v.ValueKind == JsonValueKind.String) {
+			value = v.GetString();
+			return true;
+		}
+		value = null;
+		return false;
+	}
+
+	static bool TryGetBool(JsonElement e, string key, out bool value) {
+		JsonElement v;
+		if (e.ValueKind == JsonValueKind.Object && e.TryGetProperty(key, out v) && (v.ValueKind == JsonValueKind.True || v.ValueKind == JsonValueKind.False)) {
+			value = v.GetBoolean();
+			return true;
+		}
+		value = false;
+		return false;
+	}
+
+	static bool TryGetNumber(JsonElement e, string key, out double value) {
+		JsonElement v;
+		if (e.ValueKind == JsonValueKind.Object && e.TryGetProperty(key, out v) && v.ValueKind == JsonValueKind.Number) {
+			value = v.GetDouble();
+			return true;
+		}
+		value = 0.0;
+		return false;
+	}
+
+	static string Table(string type, string name, List<string> entries) {
+		if (entries.Count == 0) {
+			return String.Format("\tstatic constexpr std::array<{0}, 0> {1} = {{}};\n", type, name);
+		}
+		return String.Format("\tstatic constexpr std::array<{0}, {1}> {2} = {{ {{\n\t\t{3}\n\t}} }};\n", type, entries.Count, name, String.Join(",\n\t\t", entries));
+	}
+
+	static string BoolLiteral(bool v) {
+		return v ? "true" : "false";
+	}
+
+	static string FloatLiteral(double v) {
+		if (Double.IsNaN(v) || Double.IsInfinity(v)) {
+			return "0.0f";
+		}
+		string s = ((float)v).ToString("R", CultureInfo.InvariantCulture);
+		if (s.IndexOfAny(new char[] { '.', 'E', 'e' }) < 0) {
+			s += ".0";
+		}
+		return s + "f";
+	}
+
+	static string CharLiteral(string v) {
+		var output = new StringBuilder("\"");
+		foreach (byte b in Encoding.UTF8.GetBytes(v)) {
+			if (b == '"' || b == '\\') {
+				output.Append('\\').Append((char)b);
+			}
+			else if (b < 0x20 || b >= 0x7F) {
+				//octal escapes can't run into the following character
+				output.Append('\\').Append(Convert.ToString(b, 8).PadLeft(3, '0'));
+			}
+			else {
+				output.Append((char)b);
+			}
+		}
+		return output.Append('"').ToString();
+	}
+
+	static string TextLiteral(string v) {
+		var output = new StringBuilder("TEXT(\"");
+		foreach (char c in v) {
+			if (c == '"' || c == '\\') {
+				output.Append('\\').Append(c);
+			}
+			else if (c < 0x20 || c >= 0x7F) {
+				output.AppendFormat("\\x{0:X4}\")TEXT(\"", (int)c);
+			}
+			else {
+				output.Append(c);
+			}
+		}
+		return output.Append("\")").ToString();
 	}
 }